@@ -0,0 +1,37 @@
+#ifndef __MAG_CODER_H_
+#define __MAG_CODER_H_
+
+#include <stdint.h>
+#include "max2769.h"
+
+//Lossless coder for multi-bit snapshots in sign/magnitude format (sign bit first, msb first)
+//Sign bits are close to random and are stored as they are. Magnitude bits are skewed by the AGC and are coded with
+//an adaptive binary range coder whose context is the magnitude of the previous sample.
+//This file does not depend on the Riotee SDK so that host tools can decode snapshots as well.
+//
+//Coded stream:
+//  4 bytes   length of the raw snapshot in bytes, little endian
+//  1 byte    bits per sample
+//  3 bytes   reserved, 0
+//  sign bits of all samples followed by the bits that do not fill a whole sample, packed msb first
+//  range coded magnitude bits
+
+//Coder ids as sent in frame 0
+#define MAG_CODER_NONE 0
+#define MAG_CODER_RANGE 1
+
+#define MAG_CODER_HEADER_LENGTH 8
+#define MAG_CODER_MAX_BITS_PER_SAMPLE 3
+//Longest raw snapshot in bytes, far above SNAPSHOT_SIZE_BYTES and small enough that bit positions fit into 32 bits
+#define MAG_CODER_MAX_LENGTH (1UL << 24)
+
+uint8_t mag_coder_bits_per_sample(max2769_adc_resolution_t adc_resolution);
+//Returns the length of the coded stream or 0 if there are no magnitude bits or the stream does not fit into capacity
+uint32_t mag_coder_encode(const uint8_t *samples, uint32_t length, uint8_t bits_per_sample, uint8_t *coded, uint32_t capacity);
+//Returns the length of the raw snapshot of a coded stream or 0 if the header is malformed or does not match coded_length
+uint32_t mag_coder_decoded_length(const uint8_t *coded, uint32_t coded_length);
+//Returns the length of the raw snapshot or 0 if the stream is malformed, is not consumed exactly or the snapshot does
+//not fit into capacity
+uint32_t mag_coder_decode(const uint8_t *coded, uint32_t coded_length, uint8_t *samples, uint32_t capacity);
+
+#endif /* __MAG_CODER_H_ */
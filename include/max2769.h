@@ -23,6 +23,11 @@ typedef enum {
   MAX2769_MIN_POWER_OPTION_DISABLE,    // configure max2769 registers with default values 
 }max2769_min_power_option_t;
 
+typedef enum {
+  MAX2769_POWER_STATE_OFF,             // power converters off, register configuration is lost
+  MAX2769_POWER_STATE_ACTIVE,          // powered, configured and ready to capture
+}max2769_power_state_t;
+
 //structure definition to store max2769 related configuration
 typedef struct {
   unsigned int snapshot_size_bytes;
@@ -30,8 +35,17 @@ typedef struct {
   max2769_adc_resolution_t adc_resolution;
   max2769_min_power_option_t min_power_option;
   unsigned int pin_pe;              //Pin that should be connected to nSHDW, nIDLE and power enable pin of power converters
+  unsigned int pin_ld;              //Pin that should be connected to the LD (PLL lock detect) output
 } max2769_cfg_t;
 
+//structure definition to report max2769 power-up timing
+typedef struct {
+  uint32_t last_lock_time_us;       //time from start of waiting until the PLL reported lock
+  uint32_t activation_lock_time_us; //longest lock time of the last activation, i.e. the power-up lock when starting from off
+  uint32_t lock_count;              //number of successful waits for PLL lock
+  uint32_t lock_timeouts;           //number of waits that ended without PLL lock
+} max2769_stats_t;
+
 //structure definition to track max2769 register status as max2769 registers cannot be read
 typedef struct {
   uint32_t conf1_value;    
@@ -42,6 +56,7 @@ typedef struct {
   uint32_t fdiv_value;   
   uint32_t strm_value;   
   uint32_t cfdr_value;
+  uint8_t configuration_valid;   //set while the device is powered and holds the register values above
 } max2769_registers_t;
 
 /* MAX2769 Register addresses */
@@ -128,6 +143,14 @@ typedef struct {
 #define  MAX2769_PLL_INT_PLL         ((uint8_t)(3))    /* PLL Mode Ctl */
 #define  MAX2769_PLL_PWRSAV          ((uint8_t)(2))    /* PLL Power Save */
 
+/* PLL LD pin output select values */
+#define  MAX2769_LDMUX_PLL_LOCK      0b0000            /* LD pin is high while the PLL is locked */
+
+/* Maximum time to wait for the PLL to lock before capturing anyway */
+#define  MAX2769_PLL_LOCK_TIMEOUT_MS 5
+#define  MAX2769_PLL_WAIT_TIMEOUT    (-1)              /* PLL did not lock within MAX2769_PLL_LOCK_TIMEOUT_MS */
+#define  MAX2769_PLL_WAIT_ABORTED    (-2)              /* teardown, the capacitor voltage got low while waiting */
+
 /* PLL Integer Division Ratio */
 #define  MAX2769_PLLIDR_NDIV         ((uint8_t)(13))   /* PLL Integer Division Ratio */
 #define  MAX2769_PLLIDR_RDIV         ((uint8_t)(3))    /* PLL Reference Division Ratio */
@@ -151,6 +174,9 @@ void max2769_init(const max2769_cfg_t *cfg);
 void enable_max2769(const max2769_cfg_t *cfg);
 void disable_max2769(const max2769_cfg_t *cfg);
 void configure_max2769(const max2769_cfg_t *cfg);
-void max2769_capture_snapshot(const max2769_cfg_t *max2769_cfg, uint8_t* snapshot_buf);
+int max2769_wait_pll_lock(const max2769_cfg_t *cfg);
+int max2769_set_power_state(const max2769_cfg_t *cfg, max2769_power_state_t state);
+const max2769_stats_t* max2769_get_stats();
+int max2769_capture_snapshot(const max2769_cfg_t *max2769_cfg, uint8_t* snapshot_buf);
 
 #endif /* __MAX2769_H_ */
\ No newline at end of file
@@ -0,0 +1,79 @@
+#ifndef __SNAPSHOT_FRAME_H_
+#define __SNAPSHOT_FRAME_H_
+
+#include <stdint.h>
+#include "timestamping.h"
+
+//This header only describes the over-the-air layout of snapshot frames.
+//It does not depend on the Riotee SDK so that host tools can include it as well.
+
+//Define the size of snapshots to be received from max2769 in bytes
+//Snapshot size depends on sampling frequency, snapshot duration and adc resolution
+#define SNAPSHOT_SIZE_BYTES 6138    // 4092000 Hz x 0.012s / 8 = 6138 Bytes
+
+#define TOTAL_NUMBER_FRAMES 27
+
+#define LENGTH_FIRST_FRAME 29
+//Fields behind transmit_timestamp were appended later, older firmware sends a shorter frame 0
+//Receivers take the fields that are present by length and use the defaults of frame_0_t for the others
+#define LENGTH_FIRST_FRAME_MIN 26
+#define SNAPSHOT_BYTES_PER_FRAME 243
+#define SNAPSHOT_BYTES_LAST_FRAME 63
+
+//Number of frames including frame 0 and length of the last frame for a payload of the given length
+//TOTAL_NUMBER_FRAMES and SNAPSHOT_BYTES_LAST_FRAME are the values for an uncoded snapshot
+#define SNAPSHOT_NUMBER_FRAMES(length) (1 + ((length) + SNAPSHOT_BYTES_PER_FRAME - 1) / SNAPSHOT_BYTES_PER_FRAME)
+#define SNAPSHOT_BYTES_LAST_FRAME_OF(length) ((length) - (SNAPSHOT_NUMBER_FRAMES(length) - 2) * SNAPSHOT_BYTES_PER_FRAME)
+
+//Byte offset for frame fields
+#define OFFSET_SNAPSHOT_ID 0
+#define OFFSET_FRAME_NUMBER 2
+#define OFFSET_SNAPSHOT_SAMPLES 4
+
+//length of fields frame header
+#define LENGTH_FRAME_HEADER 4
+#define LENGTH_SNAPSHOT_ID 2
+#define LENGTH_FRAME_NUMBER 2
+
+typedef struct {
+    uint16_t snapshot_id;
+    uint16_t frame_number;
+    uint16_t total_number_frames;
+    uint16_t bytes_per_frame;
+    uint16_t bytes_last_frame;
+    timestamp_t capture_timestamp;
+    timestamp_t transmit_timestamp;
+    uint8_t time_synced;            // 1 if a time sync from the base station was applied to the RTC since the last reset, i.e. timestamps are UTC (default 0)
+    uint8_t missed_slots;           // capture slots skipped before this snapshot in scheduled mode, 0xFF if unknown (default 0xFF)
+    uint8_t coder;                  // MAG_CODER_NONE if the data frames carry the samples, otherwise the coder of the stream they carry (default MAG_CODER_NONE)
+} frame_0_t;
+
+//Payload the base station may attach to the ACK of frame 0 to synchronize the RTC
+#define ACK_PAYLOAD_TIME_SYNC 0x01
+#define LENGTH_TIME_SYNC_PAYLOAD 16
+
+//Flags of the time sync payload
+#define TIME_SYNC_UTC_VALID (1 << 0)
+#define TIME_SYNC_DRIFT_VALID (1 << 1)
+
+typedef struct {
+    uint8_t type;                   // ACK_PAYLOAD_TIME_SYNC
+    uint8_t flags;
+    uint16_t reserved;
+    timestamp_t utc;                // time the ACK was sent, fields as in capture_timestamp
+    int32_t drift_ppb;              // rate error of the RTC since the last correction, positive if it runs fast
+} time_sync_payload_t;
+
+// typedef struct {
+//     uint16_t snapshot_id;
+//     uint16_t frame_number;
+//     uint8_t data[BYTES_PER_FRAME];
+// } middle_frames_t;
+
+// typedef struct {
+//     uint16_t snapshot_id;
+//     uint16_t frame_number;
+//     uint8_t data[BYTES_LAST_FRAME];
+// } last_frame_t;
+
+#endif /* __SNAPSHOT_FRAME_H_ */
@@ -0,0 +1,37 @@
+#ifndef __SNAPSHOT_QUALITY_H_
+#define __SNAPSHOT_QUALITY_H_
+
+#include <stdint.h>
+#include "max2769.h"
+
+//Bytes the SPIS writes if it does not receive data (see ORC and DEF in spis_init)
+#define SNAPSHOT_QUALITY_ORC_BYTE 0x01
+#define SNAPSHOT_QUALITY_DEF_BYTE 0x99
+
+//Thresholds of the statistical checks
+#define SNAPSHOT_QUALITY_MAX_FILL_PERMILLE 100          //share of SPIS fill bytes, noise contains about 8 permille
+#define SNAPSHOT_QUALITY_MAX_REPEAT_PERMILLE 100        //share of bytes equal to their predecessor, noise contains about 4 permille
+#define SNAPSHOT_QUALITY_MAX_IMBALANCE_PERMILLE 100     //deviation of the share of ones from 500 permille (1 bit samples only)
+#define SNAPSHOT_QUALITY_MIN_TRANSITION_PERMILLE 150    //share of samples that differ from their predecessor (1 bit samples only)
+#define SNAPSHOT_QUALITY_MAX_TRANSITION_PERMILLE 850
+#define SNAPSHOT_QUALITY_MAX_RUN_LENGTH 64              //longest run of equal samples (1 bit samples only)
+
+typedef enum {
+  SNAPSHOT_QUALITY_OK,
+  SNAPSHOT_QUALITY_FILL_BYTES,          // buffer mostly holds SPIS fill bytes, no data received (e.g. SPIS overrun)
+  SNAPSHOT_QUALITY_STUCK,               // buffer mostly holds repeated bytes (e.g. front-end not running)
+  SNAPSHOT_QUALITY_BIT_IMBALANCE,       // samples are biased towards one sign (e.g. antenna unplugged, dc offset)
+  SNAPSHOT_QUALITY_RUN_LENGTH,          // samples change too rarely or too often (e.g. jamming tone)
+  NUMBER_OF_SNAPSHOT_QUALITY_RESULTS
+} snapshot_quality_result_t;
+
+//structure definition to count checked and rejected snapshots per reason
+typedef struct {
+  uint32_t checked;
+  uint32_t rejected[NUMBER_OF_SNAPSHOT_QUALITY_RESULTS];   // index SNAPSHOT_QUALITY_OK counts accepted snapshots
+} snapshot_quality_stats_t;
+
+snapshot_quality_result_t snapshot_quality_check(const max2769_cfg_t *cfg, const uint8_t *snapshot_buf);
+const snapshot_quality_stats_t* snapshot_quality_get_stats();
+
+#endif /* __SNAPSHOT_QUALITY_H_ */
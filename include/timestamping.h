@@ -16,8 +16,49 @@ typedef struct {
   uint8_t wday; 
 } timestamp_t;
 
+//AM1805 registers that are not covered by the am1805 driver functions
+#define AM1805_I2C_ADDRESS 0x69
+//TWIM instance of the I2C bus the AM1805 is connected to, it must be the instance the am1805 driver of the SDK uses
+//It shares its peripheral base with SPIM0/SPIS0 (TWIM0) or SPIM1/SPIS1 (TWIM1), the SPI drivers must use neither
+#define RTC_TWIM NRF_TWIM0
+#define RTC_TWIM_TIMEOUT_US 2000    //a register access takes about 50 us at 400 kHz
+#define AM1805_REG_HUNDREDTHS 0x00
+#define AM1805_REG_CALIBRATION_XT 0x14
+#define AM1805_CALIBRATION_XT_CMDX (1 << 7)
+#define AM1805_REG_STATUS 0x0F
+#define AM1805_STATUS_TIM (1 << 3)
+#define AM1805_REG_INTERRUPT_MASK 0x12
+#define AM1805_INTERRUPT_MASK_TIE (1 << 3)
+#define AM1805_REG_TIMER_CONTROL 0x18
+#define AM1805_REG_TIMER 0x19
+#define AM1805_REG_TIMER_INITIAL 0x1A
+#define AM1805_TIMER_CONTROL_TE (1 << 7)
+#define AM1805_TIMER_CONTROL_TRPT (1 << 5)
+#define AM1805_TIMER_CONTROL_TFS_1HZ 0b10
+#define AM1805_TIMER_CONTROL_TFS_1_60HZ 0b11
+
+//Value of missed_slots in frame 0 if the number of missed slots is not known, e.g. after a reset
+#define RTC_MISSED_SLOTS_UNKNOWN 0xFF
+
+//Time the RTC may be off before it is set again, smaller offsets are within the uncertainty of a sync message
+#define RTC_SYNC_MIN_OFFSET_MS 30
+
+//structure definition for captures at a fixed cadence
+//The countdown timer of the AM1805 runs from 1 Hz up to 256 s and from 1/60 Hz up to 256 min
+typedef struct {
+  uint32_t period_s;          // time between capture slots, 1 to 256 s or a multiple of 60 s up to 15360 s
+  unsigned int pin_irq;       // pin connected to the nIRQ output of the AM1805
+} rtc_schedule_cfg_t;
+
 int get_timestamp(timestamp_t *timestamp);
+uint32_t timestamp_diff_ms(const timestamp_t *later, const timestamp_t *earlier);
 int reset_rtc();
 int rtc_init();
+int rtc_set_time(const timestamp_t *utc);
+int rtc_is_synced();
+int rtc_correct_drift(int32_t drift_ppb);
+int rtc_start_schedule(const rtc_schedule_cfg_t *cfg);
+int rtc_wait_capture_slot(const rtc_schedule_cfg_t *cfg);
+uint8_t rtc_count_missed_slots(const rtc_schedule_cfg_t *cfg, uint32_t capture_interval_ms);
 
 #endif /* __TIMESTAMPING_H_ */
\ No newline at end of file
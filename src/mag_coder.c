@@ -0,0 +1,326 @@
+#include <stdint.h>
+#include <string.h>
+#include "mag_coder.h"
+
+//Probabilities are 11 bit fixed point values of a 0 bit, adapted by 1/32 of the error after every bit
+#define PROB_BITS 11
+#define PROB_INIT (1 << (PROB_BITS - 1))
+#define PROB_ADAPT_SHIFT 5
+#define RANGE_TOP (1UL << 24)
+
+#define MAX_MAG_VALUES (1 << (MAG_CODER_MAX_BITS_PER_SAMPLE - 1))
+
+//structure definition of the context model: one binary tree of probabilities per magnitude of the previous sample
+typedef struct {
+    uint16_t probs[MAX_MAG_VALUES][MAX_MAG_VALUES];
+} mag_model_t;
+
+typedef struct {
+    uint64_t low;
+    uint32_t range;
+    uint8_t cache;
+    uint32_t cache_size;
+    uint8_t *out;
+    uint32_t pos;
+    uint32_t capacity;
+    uint8_t overflow;
+} range_encoder_t;
+
+typedef struct {
+    uint32_t range;
+    uint32_t code;
+    const uint8_t *in;
+    uint32_t pos;
+    uint32_t length;
+    uint8_t overrun;
+} range_decoder_t;
+
+static void model_init(mag_model_t *model)
+{
+    for(int i = 0; i < MAX_MAG_VALUES; i++)
+    {
+        for(int j = 0; j < MAX_MAG_VALUES; j++)
+        {
+            model->probs[i][j] = PROB_INIT;
+        }
+    }
+}
+
+static uint32_t get_bits(const uint8_t *buf, uint32_t position, uint8_t n)
+{
+    uint32_t value = 0;
+    for(uint8_t i = 0; i < n; i++, position++)
+    {
+        value = (value << 1) | ((buf[position / 8] >> (7 - position % 8)) & 1);
+    }
+    return value;
+}
+
+static void put_bits(uint8_t *buf, uint32_t position, uint8_t n, uint32_t value)
+{
+    for(int i = n - 1; i >= 0; i--, position++)
+    {
+        if((value >> i) & 1)
+        {
+            buf[position / 8] |= 0x80 >> (position % 8);
+        }
+        else
+        {
+            buf[position / 8] &= ~(0x80 >> (position % 8));
+        }
+    }
+}
+
+//Carry propagation as in LZMA: bytes that may still be changed by a carry are held back in cache and cache_size
+static void shift_low(range_encoder_t *rc)
+{
+    if((uint32_t)rc->low < 0xFF000000UL || (rc->low >> 32) != 0)
+    {
+        uint8_t carry = (uint8_t)(rc->low >> 32);
+        uint8_t byte = rc->cache;
+        do
+        {
+            if(rc->pos < rc->capacity)
+            {
+                rc->out[rc->pos++] = (uint8_t)(byte + carry);
+            }
+            else
+            {
+                rc->overflow = 1;
+            }
+            byte = 0xFF;
+        } while(--rc->cache_size != 0);
+        rc->cache = (uint8_t)(rc->low >> 24);
+    }
+    rc->cache_size++;
+    rc->low = (rc->low & 0x00FFFFFFUL) << 8;
+}
+
+static void encode_bit(range_encoder_t *rc, uint16_t *prob, uint32_t bit)
+{
+    uint32_t bound = (rc->range >> PROB_BITS) * *prob;
+    if(bit == 0)
+    {
+        rc->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_ADAPT_SHIFT;
+    }
+    else
+    {
+        rc->low += bound;
+        rc->range -= bound;
+        *prob -= *prob >> PROB_ADAPT_SHIFT;
+    }
+    while(rc->range < RANGE_TOP)
+    {
+        rc->range <<= 8;
+        shift_low(rc);
+    }
+}
+
+static uint32_t decode_bit(range_decoder_t *rc, uint16_t *prob)
+{
+    uint32_t bit;
+    uint32_t bound = (rc->range >> PROB_BITS) * *prob;
+    if(rc->code < bound)
+    {
+        rc->range = bound;
+        *prob += ((1 << PROB_BITS) - *prob) >> PROB_ADAPT_SHIFT;
+        bit = 0;
+    }
+    else
+    {
+        rc->code -= bound;
+        rc->range -= bound;
+        *prob -= *prob >> PROB_ADAPT_SHIFT;
+        bit = 1;
+    }
+    while(rc->range < RANGE_TOP)
+    {
+        rc->range <<= 8;
+        //Reading behind the end only happens for truncated streams, they are rejected after decoding
+        if(rc->pos < rc->length)
+        {
+            rc->code = (rc->code << 8) | rc->in[rc->pos++];
+        }
+        else
+        {
+            rc->code <<= 8;
+            rc->overrun = 1;
+        }
+    }
+    return bit;
+}
+
+//Function that maps the adc resolution to the number of bits the max2769 outputs per sample
+uint8_t mag_coder_bits_per_sample(max2769_adc_resolution_t adc_resolution)
+{
+    switch(adc_resolution)
+    {
+        case MAX2769_ADC_RESOLUTION_1B5:
+        case MAX2769_ADC_RESOLUTION_2B:
+            return 2;
+        case MAX2769_ADC_RESOLUTION_2B5:
+        case MAX2769_ADC_RESOLUTION_3B:
+            return 3;
+        default:
+            return 1;
+    }
+}
+
+//Function that codes a snapshot, the work is a few table lookups and multiplications per magnitude bit
+uint32_t mag_coder_encode(const uint8_t *samples, uint32_t length, uint8_t bits_per_sample, uint8_t *coded, uint32_t capacity)
+{
+    uint32_t n_samples;
+    uint32_t tail_bits;
+    uint32_t sign_bytes;
+    uint8_t mag_bits = bits_per_sample - 1;
+    uint32_t prev_mag = 0;
+    mag_model_t model;
+    range_encoder_t rc;
+
+    if(bits_per_sample < 2 || bits_per_sample > MAG_CODER_MAX_BITS_PER_SAMPLE || length == 0 || length > MAG_CODER_MAX_LENGTH)
+    {
+        return 0;
+    }
+    n_samples = length * 8 / bits_per_sample;
+    tail_bits = length * 8 - n_samples * bits_per_sample;
+    sign_bytes = (n_samples + tail_bits + 7) / 8;
+    if(capacity < MAG_CODER_HEADER_LENGTH + sign_bytes)
+    {
+        return 0;
+    }
+
+    memset(coded, 0, MAG_CODER_HEADER_LENGTH + sign_bytes);
+    coded[0] = (uint8_t)length;
+    coded[1] = (uint8_t)(length >> 8);
+    coded[2] = (uint8_t)(length >> 16);
+    coded[3] = (uint8_t)(length >> 24);
+    coded[4] = bits_per_sample;
+
+    model_init(&model);
+    rc.low = 0;
+    rc.range = 0xFFFFFFFFUL;
+    rc.cache = 0;
+    rc.cache_size = 1;
+    rc.out = coded + MAG_CODER_HEADER_LENGTH + sign_bytes;
+    rc.pos = 0;
+    rc.capacity = capacity - MAG_CODER_HEADER_LENGTH - sign_bytes;
+    rc.overflow = 0;
+
+    uint8_t *signs = coded + MAG_CODER_HEADER_LENGTH;
+    for(uint32_t k = 0; k < n_samples; k++)
+    {
+        uint32_t sample = get_bits(samples, k * bits_per_sample, bits_per_sample);
+        uint32_t mag = sample & ((1 << mag_bits) - 1);
+        uint32_t node = 1;
+        put_bits(signs, k, 1, sample >> mag_bits);
+        //Magnitude bits msb first, every bit is coded in the context of the bits before it
+        for(int i = mag_bits - 1; i >= 0; i--)
+        {
+            uint32_t bit = (mag >> i) & 1;
+            encode_bit(&rc, &model.probs[prev_mag][node], bit);
+            node = (node << 1) | bit;
+        }
+        prev_mag = mag;
+        if(rc.overflow)
+        {
+            return 0;
+        }
+    }
+    put_bits(signs, n_samples, tail_bits, get_bits(samples, n_samples * bits_per_sample, tail_bits));
+    for(int i = 0; i < 5; i++)
+    {
+        shift_low(&rc);
+    }
+    if(rc.overflow)
+    {
+        return 0;
+    }
+    return MAG_CODER_HEADER_LENGTH + sign_bytes + rc.pos;
+}
+
+//Function that returns the size of the sign bits and tail bits of a snapshot in bytes
+//The length is limited to MAG_CODER_MAX_LENGTH, so the bit counts fit into 32 bits
+static uint32_t sign_bytes_of(uint32_t length, uint8_t bits_per_sample)
+{
+    uint64_t bits = (uint64_t)length * 8;
+    uint64_t n_samples = bits / bits_per_sample;
+    return (uint32_t)((n_samples + (bits - n_samples * bits_per_sample) + 7) / 8);
+}
+
+uint32_t mag_coder_decoded_length(const uint8_t *coded, uint32_t coded_length)
+{
+    uint32_t length;
+    if(coded_length < MAG_CODER_HEADER_LENGTH || coded[4] < 2 || coded[4] > MAG_CODER_MAX_BITS_PER_SAMPLE)
+    {
+        return 0;
+    }
+    length = (uint32_t)coded[0] | ((uint32_t)coded[1] << 8) | ((uint32_t)coded[2] << 16) | ((uint32_t)coded[3] << 24);
+    //The range coder emits at least 5 bytes behind the sign bits
+    if(length == 0 || length > MAG_CODER_MAX_LENGTH ||
+       (uint64_t)coded_length < (uint64_t)MAG_CODER_HEADER_LENGTH + sign_bytes_of(length, coded[4]) + 5)
+    {
+        return 0;
+    }
+    return length;
+}
+
+uint32_t mag_coder_decode(const uint8_t *coded, uint32_t coded_length, uint8_t *samples, uint32_t capacity)
+{
+    uint32_t length = mag_coder_decoded_length(coded, coded_length);
+    uint8_t bits_per_sample;
+    uint8_t mag_bits;
+    uint32_t n_samples;
+    uint32_t tail_bits;
+    uint32_t sign_bytes;
+    uint32_t prev_mag = 0;
+    mag_model_t model;
+    range_decoder_t rc;
+
+    //The header is only read once mag_coder_decoded_length checked that it is there
+    if(length == 0 || length > capacity)
+    {
+        return 0;
+    }
+    bits_per_sample = coded[4];
+    mag_bits = bits_per_sample - 1;
+    n_samples = length * 8 / bits_per_sample;
+    tail_bits = length * 8 - n_samples * bits_per_sample;
+    sign_bytes = sign_bytes_of(length, bits_per_sample);
+
+    model_init(&model);
+    rc.in = coded + MAG_CODER_HEADER_LENGTH + sign_bytes;
+    rc.length = coded_length - MAG_CODER_HEADER_LENGTH - sign_bytes;
+    rc.range = 0xFFFFFFFFUL;
+    rc.code = 0;
+    rc.overrun = 0;
+    //The first byte of the encoder is always 0
+    if(rc.in[0] != 0)
+    {
+        return 0;
+    }
+    for(rc.pos = 1; rc.pos < 5; rc.pos++)
+    {
+        rc.code = (rc.code << 8) | rc.in[rc.pos];
+    }
+
+    const uint8_t *signs = coded + MAG_CODER_HEADER_LENGTH;
+    for(uint32_t k = 0; k < n_samples; k++)
+    {
+        uint32_t node = 1;
+        for(int i = mag_bits - 1; i >= 0; i--)
+        {
+            node = (node << 1) | decode_bit(&rc, &model.probs[prev_mag][node]);
+        }
+        uint32_t mag = node & ((1 << mag_bits) - 1);
+        put_bits(samples, k * bits_per_sample, bits_per_sample, (get_bits(signs, k, 1) << mag_bits) | mag);
+        prev_mag = mag;
+    }
+    put_bits(samples, n_samples * bits_per_sample, tail_bits, get_bits(signs, n_samples, tail_bits));
+    //The decoder reads exactly the bytes the encoder wrote, anything else is a truncated or padded stream
+    if(rc.overrun || rc.pos != rc.length)
+    {
+        return 0;
+    }
+    return length;
+}
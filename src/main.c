@@ -5,16 +5,34 @@
 #include "riotee_spis.h"
 #include "max2769.h"
 #include "snapshot_handler.h"
+#include "snapshot_quality.h"
+#include "mag_coder.h"
 #include "printf.h"
 #include "prbs.h"
 
+//Uncomment to capture at the fixed cadence of rtc_schedule_cfg instead of as often as energy allows
+// #define SCHEDULED_CAPTURE
+//Uncomment to entropy code the magnitude bits of multi-bit snapshots before they are sent
+// #define CODE_MAGNITUDE_BITS
+
+//Time to wait before capturing again after a failed capture
+#define CAPTURE_RETRY_BACKOFF_MS 1000
+
 //Global buffer to store gnss snapshot
 uint8_t snapshot_buf[SNAPSHOT_SIZE_BYTES] __VOLATILE_UNINITIALIZED;
 uint16_t snapshot_id = 0;
+#ifdef CODE_MAGNITUDE_BITS
+//Global buffer to store the coded snapshot
+uint8_t coded_buf[SNAPSHOT_SIZE_BYTES];
+#endif
 
 //Global structures to store timestamps
 timestamp_t capture_timestamp;
 timestamp_t transmit_timestamp;
+timestamp_t sent_capture_timestamp;
+
+//Capture slots skipped before the current snapshot, only counted in scheduled mode
+uint8_t missed_slots = 0;
 
 //Define Device ID for communication with base station
 const uint32_t dev_id = 101;
@@ -36,7 +54,11 @@ const static max2769_cfg_t max2769_cfg = {.snapshot_size_bytes = SNAPSHOT_SIZE_B
                                           .sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M4,
                                           .adc_resolution = MAX2769_ADC_RESOLUTION_1B,
                                           .min_power_option = MAX2769_MIN_POWER_OPTION_DISABLE,
-                                          .pin_pe = PIN_D7};
+                                          .pin_pe = PIN_D7,
+                                          .pin_ld = PIN_D6};
+
+const static rtc_schedule_cfg_t rtc_schedule_cfg = {.period_s = 60,
+                                                    .pin_irq = PIN_D0};
 
 /* This gets called one time after flashing new firmware */
 void bootstrap_callback(void) {
@@ -55,6 +77,10 @@ void reset_callback(void) {
   init_snapshot_transmitter(dev_id);
   //Check that RTC is available
   rtc_init();
+#ifdef SCHEDULED_CAPTURE
+  //Keeps the cadence of a schedule that survived the reset
+  rtc_start_schedule(&rtc_schedule_cfg);
+#endif
 }
 
 /* This gets called when capacitor voltage gets low */
@@ -66,7 +92,38 @@ int main(void) {
   for (;;) {
     //Capture a GNSS snapshot and take a timestamp
     riotee_wait_cap_charged();
-    get_timestamped_snapshot(&max2769_cfg, snapshot_buf, &capture_timestamp);
+#ifdef SCHEDULED_CAPTURE
+    //Sleep until the next slot
+    if(rtc_wait_capture_slot(&rtc_schedule_cfg) != 0)
+    {
+      //Retrying right away would poll the RTC until the capacitor is empty, so capture one period later unscheduled
+      printf_("Waiting for capture slot failed\n");
+      riotee_sleep_ms(rtc_schedule_cfg.period_s * 1000);
+      riotee_wait_cap_charged();
+    }
+#endif
+    int capture_result = get_timestamped_snapshot(&max2769_cfg, snapshot_buf, &capture_timestamp);
+    //A capture aborted by teardown leaves a partial buffer, capture again with the same ID
+    //Backing off keeps a capture that keeps failing from retrying at full power
+    if(capture_result != 0)
+    {
+      printf_("Capture failed\n");
+      riotee_sleep_ms(CAPTURE_RETRY_BACKOFF_MS);
+      continue;
+    }
+#ifdef SCHEDULED_CAPTURE
+    //Slots since the last sent snapshot were skipped for lack of energy or rejected by the quality check
+    missed_slots = (snapshot_id > 0) ? rtc_count_missed_slots(&rtc_schedule_cfg, timestamp_diff_ms(&capture_timestamp, &sent_capture_timestamp))
+                                     : RTC_MISSED_SLOTS_UNKNOWN;
+#endif
+    //Drop snapshots that are not worth the energy of sending them and capture again with the same ID
+    snapshot_quality_result_t quality = snapshot_quality_check(&max2769_cfg, snapshot_buf);
+    if(quality != SNAPSHOT_QUALITY_OK)
+    {
+      printf_("Snapshot rejected: %u (%u of %u)\n", (unsigned int) quality,
+              (unsigned int) snapshot_quality_get_stats()->rejected[quality], (unsigned int) snapshot_quality_get_stats()->checked);
+      continue;
+    }
     // riotee_wait_cap_charged();
     // for(int k = 0; k < max2769_cfg.snapshot_size_bytes; k++)
 	  // {
@@ -79,16 +136,32 @@ int main(void) {
     //prbs_gen(snapshot_buf, SNAPSHOT_SIZE_BYTES, 0x02);
     // increment_gen(snapshot_buf, SNAPSHOT_SIZE_BYTES);
 
+    const uint8_t *payload = snapshot_buf;
+    uint32_t payload_length = SNAPSHOT_SIZE_BYTES;
+    uint8_t coder = MAG_CODER_NONE;
+#ifdef CODE_MAGNITUDE_BITS
+    //Snapshots without magnitude bits or that do not get smaller are sent as they are
+    uint32_t coded_length = mag_coder_encode(snapshot_buf, SNAPSHOT_SIZE_BYTES, mag_coder_bits_per_sample(max2769_cfg.adc_resolution),
+                                             coded_buf, sizeof(coded_buf));
+    if((coded_length > 0) && (coded_length < SNAPSHOT_SIZE_BYTES))
+    {
+      payload = coded_buf;
+      payload_length = coded_length;
+      coder = MAG_CODER_RANGE;
+    }
+#endif
+
     //Take another timestamp and send both timestamps to base station to allow recalculation of snapshot caputre time
     riotee_wait_cap_charged();
-    take_timestamp_and_send_first_frame(&capture_timestamp, &transmit_timestamp, snapshot_id);
+    take_timestamp_and_send_first_frame(&capture_timestamp, &transmit_timestamp, snapshot_id, missed_slots, payload_length, coder);
     //Divide snapshot into several frames and send them one after another
-    for(uint16_t frame_number=1;frame_number<TOTAL_NUMBER_FRAMES;frame_number++)
+    for(uint16_t frame_number=1;frame_number<SNAPSHOT_NUMBER_FRAMES(payload_length);frame_number++)
     {
       riotee_wait_cap_charged();
-      send_snapshot_data_frame(snapshot_buf, frame_number, snapshot_id);
+      send_snapshot_data_frame(payload, payload_length, frame_number, snapshot_id);
     }
     //Next snapshot gets incremented ID
+    sent_capture_timestamp = capture_timestamp;
     snapshot_id++;
   }
 }
@@ -1,6 +1,10 @@
 #include <stdint.h>
 #include "printf.h"
+#include "nrf.h"
 #include "nrf_gpio.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "runtime.h"
 #include "riotee_spic.h"
 #include "riotee_spis.h"
 #include "max2769.h"
@@ -24,6 +28,10 @@ static void reduce_vco_current();
 static void reduce_pll_current();
 static void enable_q_channel();
 static void disable_q_channel();
+static void select_ld_output(uint32_t ldmux);
+static int wait_for_activation(const max2769_cfg_t *cfg);
+
+TEARDOWN_FUN(max2769_teardown_ptr);
 
 static uint8_t tx_buf[4];           //buffer to store bytes to be transmitted to max2769
 static uint8_t rx_buf[1];           //dummy buffer, no data is expected to be received from max2769
@@ -33,6 +41,12 @@ static const size_t n_rx = 0;       //no data is expected to be received from ma
 //global structure to track max2769 register status as max2769 registers cannot be read
 //This initialisation does not work!!! Initialisation is done again in max2769_init(..)
 static max2769_registers_t max2769_reg;
+//global structure to report power-up timing
+static max2769_stats_t max2769_stats;
+//pin connected to the LD output, stored for the teardown function
+static unsigned int pin_ld;
+//current power state of the max2769
+static max2769_power_state_t max2769_power_state;
 
 //Function that configures all gpios that are connected to max2769 
 //This functions should be executed once after system reset
@@ -46,9 +60,20 @@ void max2769_init(const max2769_cfg_t *cfg)
     max2769_reg.fdiv_value = MAX2769_FDIV_DEF;
     max2769_reg.strm_value = MAX2769_STRM_DEF;
     max2769_reg.cfdr_value = MAX2769_CFDR_DEF;
+    max2769_reg.configuration_valid = 0;
+    max2769_power_state = MAX2769_POWER_STATE_OFF;
+    //LD pin shall signal PLL lock, the value is written together with the next PLLCONF write
+    select_ld_output(MAX2769_LDMUX_PLL_LOCK);
     //configure pin used for max2769 power_enable, shutdown_n and idle_n and set it low to keep the device off
 	nrf_gpio_cfg_output(cfg->pin_pe);
 	nrf_gpio_pin_clear(cfg->pin_pe);
+    //configure pin connected to the LD output, no sensing until waiting for PLL lock
+    pin_ld = cfg->pin_ld;
+    nrf_gpio_cfg_input(cfg->pin_ld, NRF_GPIO_PIN_NOPULL);
+    //Timer measures the time until PLL lock with 1us resolution
+    NRF_TIMER4->MODE = TIMER_MODE_MODE_Timer << TIMER_MODE_MODE_Pos;
+    NRF_TIMER4->BITMODE = TIMER_BITMODE_BITMODE_32Bit << TIMER_BITMODE_BITMODE_Pos;
+    NRF_TIMER4->PRESCALER = 4;
 }
 
 //Function that enables the max2769 board
@@ -59,10 +84,14 @@ void enable_max2769(const max2769_cfg_t *cfg)
 }
 
 //Function that disables the max2769 board
+//This function is also called from turnoff_callback, so it must work in any power state
 void disable_max2769(const max2769_cfg_t *cfg)
 {
     //Disable power converter for max2769 and clear nSHDN and nIDLE pins
 	nrf_gpio_pin_clear(cfg->pin_pe);
+    //Registers return to their defaults at the next power-up
+    max2769_reg.configuration_valid = 0;
+    max2769_power_state = MAX2769_POWER_STATE_OFF;
 }
 
 //Function that writes max2769 registers over SPI to establish an application specific configuration
@@ -84,13 +113,148 @@ void configure_max2769(const max2769_cfg_t *cfg)
         reduce_pll_current();         //main division ratio must be divisible by 32 when reducing current!
     }
     //Info: Default values for IF center frequency are taken: fCENTER = 4MHz, BW = 2.5MHz
+    max2769_reg.configuration_valid = 1;
+}
+
+//Function that brings the max2769 into the requested power state
+//ACTIVE: powers up, configures the registers only if the configuration was lost and waits for PLL lock
+//OFF: disables power, the register configuration is lost
+//Returns 0 on success and a negative value if power was lost while activating
+//If activating fails the max2769 is left off, so the stored state always matches the hardware
+int max2769_set_power_state(const max2769_cfg_t *cfg, max2769_power_state_t state)
+{
+    if(state == max2769_power_state)
+    {
+        return 0;
+    }
+    switch(state)
+    {
+        case MAX2769_POWER_STATE_ACTIVE:
+            max2769_stats.activation_lock_time_us = 0;
+            enable_max2769(cfg);
+            //Wait until max2769 is powered up and its PLL has locked instead of sleeping for a fixed time
+            if(wait_for_activation(cfg) != 0)
+            {
+                return -1;
+            }
+            if(!max2769_reg.configuration_valid)
+            {
+                configure_max2769(cfg);
+            }
+            //Configuration changes PLL settings, so make sure the PLL is locked before capturing
+            if(wait_for_activation(cfg) != 0)
+            {
+                return -1;
+            }
+            break;
+        case MAX2769_POWER_STATE_OFF:
+            disable_max2769(cfg);
+            break;
+    }
+    max2769_power_state = state;
+    return 0;
+}
+
+//Function that waits for PLL lock while activating and keeps the longest lock time of the activation
+//Waiting only saves the fixed sleep: without lock the capture goes ahead after MAX2769_PLL_LOCK_TIMEOUT_MS as it did
+//with the sleep, the timeout is counted in max2769_stats. Only teardown makes the activation fail, turnoff_callback
+//powers the device down then
+static int wait_for_activation(const max2769_cfg_t *cfg)
+{
+    int result = max2769_wait_pll_lock(cfg);
+    if(result == MAX2769_PLL_WAIT_ABORTED)
+    {
+        disable_max2769(cfg);
+        return -1;
+    }
+    if((result == 0) && (max2769_stats.last_lock_time_us > max2769_stats.activation_lock_time_us))
+    {
+        max2769_stats.activation_lock_time_us = max2769_stats.last_lock_time_us;
+    }
+    return 0;
+}
+
+//Function that stops waiting for PLL lock when the capacitor voltage gets low and notifys rtos that waiting is aborted
+static void teardown() {
+    //Disable sensing on LD pin to prevent further interrupts
+    nrf_gpio_cfg_input(pin_ld, NRF_GPIO_PIN_NOPULL);
+    //Stop timer to save power
+    NRF_TIMER4->TASKS_STOP = 1;
+    NRF_TIMER4->TASKS_SHUTDOWN = 1;
+    //Notify RTOS that teardown function is executed and operation is aborted
+    xTaskNotifyIndexed(usr_task_handle, 1, EVT_TEARDOWN, eSetValueWithOverwrite);
+    //unregister teardown function pointer as the operation aborted
+    max2769_teardown_ptr = NULL;
+}
+
+//Function that blocks until the LD pin signals PLL lock or MAX2769_PLL_LOCK_TIMEOUT_MS has passed
+//Returns 0 if the PLL is locked, MAX2769_PLL_WAIT_TIMEOUT if it did not lock in time and MAX2769_PLL_WAIT_ABORTED on teardown
+//The rising edge of LD triggers a GPIOTE PORT event whose interrupt notifies the user task with EVT_GPIO
+int max2769_wait_pll_lock(const max2769_cfg_t *cfg)
+{
+    unsigned long notification_value = 0;
+    int aborted;
+    int locked;
+
+    NRF_TIMER4->TASKS_CLEAR = 1;
+    NRF_TIMER4->TASKS_START = 1;
+
+    taskENTER_CRITICAL();
+    //Clear all rtos notifications assigned to user task before the interrupt can occur
+    xTaskNotifyStateClearIndexed(usr_task_handle, 1);
+    //Sense high level on LD pin to generate a PORT event as soon as the PLL locks
+    nrf_gpio_cfg_sense_input(cfg->pin_ld, NRF_GPIO_PIN_NOPULL, NRF_GPIO_PIN_SENSE_HIGH);
+    NRF_GPIOTE->EVENTS_PORT = 0;
+    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+    //Register teardown function pointer while operation is in progress
+    max2769_teardown_ptr = teardown;
+    taskEXIT_CRITICAL();
+
+    //PLL may already be locked, e.g. when waiting after reconfiguration
+    if (nrf_gpio_pin_read(cfg->pin_ld) == 0)
+    {
+        //Block until PORT event notification or timeout
+        xTaskNotifyWaitIndexed(1, 0xFFFFFFFF, 0xFFFFFFFF, &notification_value, pdMS_TO_TICKS(MAX2769_PLL_LOCK_TIMEOUT_MS));
+    }
+    NRF_TIMER4->TASKS_CAPTURE[0] = 1;
+    aborted = (notification_value == EVT_TEARDOWN);
+    locked = !aborted && (nrf_gpio_pin_read(cfg->pin_ld) == 1);
+
+    taskENTER_CRITICAL();
+    //Disable sensing on LD pin
+    nrf_gpio_cfg_input(cfg->pin_ld, NRF_GPIO_PIN_NOPULL);
+    //unregister teardown function pointer as the operation finished
+    max2769_teardown_ptr = NULL;
+    taskEXIT_CRITICAL();
+    NRF_TIMER4->TASKS_STOP = 1;
+    NRF_TIMER4->TASKS_SHUTDOWN = 1;
+
+    if (aborted)
+    {
+        return MAX2769_PLL_WAIT_ABORTED;
+    }
+    if (!locked)
+    {
+        max2769_stats.lock_timeouts++;
+        return MAX2769_PLL_WAIT_TIMEOUT;
+    }
+    max2769_stats.last_lock_time_us = NRF_TIMER4->CC[0];
+    max2769_stats.lock_count++;
+    return 0;
+}
+
+//Function that gives access to max2769 power-up timing
+const max2769_stats_t* max2769_get_stats()
+{
+    return &max2769_stats;
 }
 
 //Function that enables an customized spi slave to receive a snapshot from max2769
 //Note: max2769 must be enabled and configured in advance
-void max2769_capture_snapshot(const max2769_cfg_t *max2769_cfg, uint8_t* snapshot_buf)
+int max2769_capture_snapshot(const max2769_cfg_t *max2769_cfg, uint8_t* snapshot_buf)
 {
-    spis_receive(snapshot_buf, max2769_cfg->snapshot_size_bytes);	
+    //Fails if the capture was aborted by teardown, the buffer then only holds part of a snapshot
+    return spis_receive(snapshot_buf, max2769_cfg->snapshot_size_bytes);
 }
 
 //Function that implements writing a 28bit value to a max2769 register with a 4 bit address
@@ -228,6 +392,13 @@ static void enable_q_channel()
     write_max2769_register(REG_MAX2769_CONF3, max2769_reg.conf3_value);
 }
 
+static void select_ld_output(uint32_t ldmux)
+{
+    //clear bits that correspond to the LD pin output select
+    max2769_reg.pllconf_value &= ~(0b1111 << MAX2769_PLL_LDMUX);
+    max2769_reg.pllconf_value |= (ldmux << MAX2769_PLL_LDMUX);
+}
+
 static void disable_q_channel()
 {
     max2769_reg.conf2_value &= ~(1 << MAX2769_CONF2_IQEN);
@@ -12,16 +12,21 @@ static riotee_stella_pkt_t rx_buf;
 // Counts number of transmitted packets
 static uint16_t stella_pkt_counter = 0;
 
+//Function that powers up the max2769, captures a snapshot and powers the max2769 down again
 int get_timestamped_snapshot(const max2769_cfg_t *max2769_cfg, uint8_t *snapshot_buf, timestamp_t *capture_timestamp)
 {
     int result = 0;
-    enable_max2769(max2769_cfg);
-    riotee_sleep_ms(1);
-    configure_max2769(max2769_cfg);
-    riotee_sleep_ms(1);
+    //Powers up and configures the max2769 and waits for PLL lock
+    //This only fails if power was lost, the max2769 is off again then and there is nothing to capture
+    if(max2769_set_power_state(max2769_cfg, MAX2769_POWER_STATE_ACTIVE) != 0)
+    {
+        return -1;
+    }
     result += get_timestamp(capture_timestamp);
-    max2769_capture_snapshot(max2769_cfg, snapshot_buf);
-    disable_max2769(max2769_cfg);
+    result += max2769_capture_snapshot(max2769_cfg, snapshot_buf);
+    result += max2769_set_power_state(max2769_cfg, MAX2769_POWER_STATE_OFF);
+    //Printing takes milliseconds, so it waits until the front-end no longer draws its active current
+    printf_("PLL lock time: %u us\n", (unsigned int) max2769_get_stats()->activation_lock_time_us);
     return result;
 }
 
@@ -31,66 +36,82 @@ void init_snapshot_transmitter(uint32_t dev_id)
     riotee_stella_set_id(dev_id);
 }
 
-int take_timestamp_and_send_first_frame(timestamp_t *capture_timestamp, timestamp_t *transmit_timestamp, uint16_t snapshot_id)
+int take_timestamp_and_send_first_frame(timestamp_t *capture_timestamp, timestamp_t *transmit_timestamp, uint16_t snapshot_id, uint8_t missed_slots,
+                                        uint32_t payload_length, uint8_t coder)
 {
     //Prepare content of frame to be sent
     frame_0_t frame_0;
     frame_0.snapshot_id = snapshot_id;
     frame_0.frame_number = 0;
-    frame_0.total_number_frames = TOTAL_NUMBER_FRAMES;
+    //The number of frames depends on the length of the coded snapshot
+    frame_0.total_number_frames = SNAPSHOT_NUMBER_FRAMES(payload_length);
     frame_0.bytes_per_frame = SNAPSHOT_BYTES_PER_FRAME;
-    frame_0.bytes_last_frame = SNAPSHOT_BYTES_LAST_FRAME;
+    frame_0.bytes_last_frame = SNAPSHOT_BYTES_LAST_FRAME_OF(payload_length);
     frame_0.capture_timestamp = *capture_timestamp;
 
     //Take transmit timestamp and insert it
     get_timestamp(transmit_timestamp);
     frame_0.transmit_timestamp = *transmit_timestamp;
+    //Syncs are only applied from the ACK of frame 0, so the flag also held when the capture timestamp was taken
+    frame_0.time_synced = rtc_is_synced();
+    frame_0.missed_slots = missed_slots;
+    frame_0.coder = coder;
 
     //Prepare parameters of stella packet and send it
     tx_buf.len = sizeof(riotee_stella_pkt_header_t) + LENGTH_FIRST_FRAME;
     tx_buf.hdr.pkt_id = stella_pkt_counter++;
     memcpy(tx_buf.data, &frame_0, LENGTH_FIRST_FRAME);
-    return riotee_stella_verified_transmission(20, &rx_buf, &tx_buf);
+    int result = riotee_stella_verified_transmission(20, &rx_buf, &tx_buf);
+    if(result == STELLA_ERR_OK)
+    {
+        handle_time_sync(&rx_buf);
+    }
+    return result;
 }
 
-int send_snapshot_data_frame(uint8_t *snapshot_buf, uint16_t frame_number, uint16_t snapshot_id)
+//Function that disciplines the RTC if the ACK carries time sync information from the base station
+void handle_time_sync(const riotee_stella_pkt_t *rx_pkt)
 {
-    int frame_byte_offset = (int)(frame_number-1) * (int)SNAPSHOT_BYTES_PER_FRAME;
-    //Check that this is NOT the last frame to be sent
-    if(frame_number != (TOTAL_NUMBER_FRAMES-1))
+    time_sync_payload_t payload;
+    if((rx_pkt->len < sizeof(riotee_stella_pkt_header_t) + LENGTH_TIME_SYNC_PAYLOAD) || (rx_pkt->data[0] != ACK_PAYLOAD_TIME_SYNC))
     {
-        //Set length of stella packet
-        size_t frame_data_length = SNAPSHOT_BYTES_PER_FRAME + LENGTH_FRAME_HEADER;
-        tx_buf.len = sizeof(riotee_stella_pkt_header_t) + frame_data_length;
-        //Prepare stella packet content
-        //insert pkt_id
-        tx_buf.hdr.pkt_id = stella_pkt_counter++;
-        //insert snapshot id
-        memcpy((tx_buf.data + OFFSET_SNAPSHOT_ID), &snapshot_id, LENGTH_SNAPSHOT_ID);
-        //insert frame number
-        memcpy((tx_buf.data + OFFSET_FRAME_NUMBER), &frame_number, LENGTH_FRAME_NUMBER);
-        //insert snapshot data
-        memcpy((tx_buf.data + OFFSET_SNAPSHOT_SAMPLES), (snapshot_buf + frame_byte_offset), SNAPSHOT_BYTES_PER_FRAME);
-        //Send stella packet
-        return riotee_stella_verified_transmission(20, &rx_buf, &tx_buf);
+        return;
     }
-    else //Last frame
+    memcpy(&payload, rx_pkt->data, LENGTH_TIME_SYNC_PAYLOAD);
+    if(payload.flags & TIME_SYNC_UTC_VALID)
     {
-        //Set length of stella packet
-        size_t frame_data_length = SNAPSHOT_BYTES_LAST_FRAME + LENGTH_FRAME_HEADER;
-        tx_buf.len = sizeof(riotee_stella_pkt_header_t) + frame_data_length;
-        //Prepare stella packet content
-        //insert pkt_id
-        tx_buf.hdr.pkt_id = stella_pkt_counter++;
-        //insert snapshot id
-        memcpy((tx_buf.data + OFFSET_SNAPSHOT_ID), &snapshot_id, LENGTH_SNAPSHOT_ID);
-        //insert frame number
-        memcpy((tx_buf.data + OFFSET_FRAME_NUMBER), &frame_number, LENGTH_FRAME_NUMBER);
-        //insert snapshot data
-        memcpy((tx_buf.data + OFFSET_SNAPSHOT_SAMPLES), (snapshot_buf + frame_byte_offset), SNAPSHOT_BYTES_LAST_FRAME);
-        //Send stella packet
-        return riotee_stella_verified_transmission(20, &rx_buf, &tx_buf);
+        if(rtc_set_time(&payload.utc) != 0)
+        {
+            printf_("RTC time sync failed\n");
+        }
     }
+    if(payload.flags & TIME_SYNC_DRIFT_VALID)
+    {
+        if(rtc_correct_drift(payload.drift_ppb) != 0)
+        {
+            printf_("RTC drift correction failed\n");
+        }
+    }
+}
+
+int send_snapshot_data_frame(const uint8_t *payload, uint32_t payload_length, uint16_t frame_number, uint16_t snapshot_id)
+{
+    int frame_byte_offset = (int)(frame_number-1) * (int)SNAPSHOT_BYTES_PER_FRAME;
+    //Only the last frame carries fewer bytes, its length depends on the length of the coded snapshot
+    size_t frame_bytes = (frame_number == (SNAPSHOT_NUMBER_FRAMES(payload_length)-1)) ? SNAPSHOT_BYTES_LAST_FRAME_OF(payload_length) : SNAPSHOT_BYTES_PER_FRAME;
+    //Set length of stella packet
+    tx_buf.len = sizeof(riotee_stella_pkt_header_t) + LENGTH_FRAME_HEADER + frame_bytes;
+    //Prepare stella packet content
+    //insert pkt_id
+    tx_buf.hdr.pkt_id = stella_pkt_counter++;
+    //insert snapshot id
+    memcpy((tx_buf.data + OFFSET_SNAPSHOT_ID), &snapshot_id, LENGTH_SNAPSHOT_ID);
+    //insert frame number
+    memcpy((tx_buf.data + OFFSET_FRAME_NUMBER), &frame_number, LENGTH_FRAME_NUMBER);
+    //insert snapshot data
+    memcpy((tx_buf.data + OFFSET_SNAPSHOT_SAMPLES), (payload + frame_byte_offset), frame_bytes);
+    //Send stella packet
+    return riotee_stella_verified_transmission(20, &rx_buf, &tx_buf);
 }
 
 int riotee_stella_verified_transmission(int max_retransmissions, riotee_stella_pkt_t *rx_pkt, riotee_stella_pkt_t *tx_pkt)
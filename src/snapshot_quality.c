@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <string.h>
+#include "snapshot_quality.h"
+
+//global structure to count checked and rejected snapshots
+static snapshot_quality_stats_t snapshot_quality_stats;
+
+//Function that decides if a snapshot is worth the energy of transmitting it
+//The statistical checks look at every byte once
+snapshot_quality_result_t snapshot_quality_check(const max2769_cfg_t *cfg, const uint8_t *snapshot_buf)
+{
+    snapshot_quality_result_t result = SNAPSHOT_QUALITY_OK;
+    uint32_t n = cfg->snapshot_size_bytes;
+    uint32_t fill_bytes = 0;
+    uint32_t repeated_bytes = 0;
+    uint32_t ones = 0;
+    uint32_t transitions = 0;
+    uint32_t run_length = 0;
+    uint32_t max_run_length = 0;
+    uint8_t last_sample = snapshot_buf[0] >> 7;
+
+    for(uint32_t k = 0; k < n; k++)
+    {
+        uint8_t byte = snapshot_buf[k];
+        if(byte == SNAPSHOT_QUALITY_ORC_BYTE || byte == SNAPSHOT_QUALITY_DEF_BYTE)
+        {
+            fill_bytes++;
+        }
+        if(k > 0 && byte == snapshot_buf[k-1])
+        {
+            repeated_bytes++;
+        }
+        //Samples are received msb first, compare every sample with the one before it
+        ones += __builtin_popcount(byte);
+        transitions += __builtin_popcount((uint8_t)(byte ^ ((byte >> 1) | (last_sample << 7))));
+        if(byte == 0x00 || byte == 0xFF)
+        {
+            run_length = ((byte & 1) == last_sample) ? run_length + 8 : 8;
+        }
+        else
+        {
+            for(int bit = 7; bit >= 0; bit--)
+            {
+                uint8_t sample = (byte >> bit) & 1;
+                run_length = (sample == last_sample) ? run_length + 1 : 1;
+                last_sample = sample;
+                if(run_length > max_run_length)
+                {
+                    max_run_length = run_length;
+                }
+            }
+        }
+        last_sample = byte & 1;
+        if(run_length > max_run_length)
+        {
+            max_run_length = run_length;
+        }
+    }
+
+    if(fill_bytes * 1000 > SNAPSHOT_QUALITY_MAX_FILL_PERMILLE * n)
+    {
+        result = SNAPSHOT_QUALITY_FILL_BYTES;
+    }
+    else if(repeated_bytes * 1000 > SNAPSHOT_QUALITY_MAX_REPEAT_PERMILLE * n)
+    {
+        result = SNAPSHOT_QUALITY_STUCK;
+    }
+    //The remaining checks rely on every bit being the sign of one sample
+    else if(cfg->adc_resolution == MAX2769_ADC_RESOLUTION_1B)
+    {
+        uint32_t n_samples = 8 * n;
+        uint32_t ones_permille = (uint32_t)(((uint64_t)ones * 1000) / n_samples);
+        uint32_t transitions_permille = (uint32_t)(((uint64_t)transitions * 1000) / n_samples);
+        if(ones_permille + SNAPSHOT_QUALITY_MAX_IMBALANCE_PERMILLE < 500 ||
+           ones_permille > 500 + SNAPSHOT_QUALITY_MAX_IMBALANCE_PERMILLE)
+        {
+            result = SNAPSHOT_QUALITY_BIT_IMBALANCE;
+        }
+        else if(transitions_permille < SNAPSHOT_QUALITY_MIN_TRANSITION_PERMILLE ||
+                transitions_permille > SNAPSHOT_QUALITY_MAX_TRANSITION_PERMILLE ||
+                max_run_length > SNAPSHOT_QUALITY_MAX_RUN_LENGTH)
+        {
+            result = SNAPSHOT_QUALITY_RUN_LENGTH;
+        }
+    }
+
+    snapshot_quality_stats.checked++;
+    snapshot_quality_stats.rejected[result]++;
+    return result;
+}
+
+//Function that gives access to the counters of checked and rejected snapshots
+const snapshot_quality_stats_t* snapshot_quality_get_stats()
+{
+    return &snapshot_quality_stats;
+}
+
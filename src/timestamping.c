@@ -2,6 +2,26 @@
 #include <stdint.h>
 #include <time.h>
 #include "riotee_am1805.h"
+#include "nrf.h"
+#include "nrf_gpio.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "runtime.h"
+#include "riotee.h"
+
+//Internal function prototypes
+static int read_rtc_register(uint8_t address, uint8_t *value);
+static int write_rtc_register(uint8_t address, uint8_t value);
+static int clear_timer_interrupt();
+static int rtc_transfer(const uint8_t *tx, uint32_t n_tx, uint8_t *rx, uint32_t n_rx);
+static void teardown();
+
+TEARDOWN_FUN(rtc_teardown_ptr);
+
+//pin connected to nIRQ, stored for the teardown function
+static unsigned int pin_irq;
+//set once a time sync from the base station was applied, cleared when the RTC is reset
+static uint8_t rtc_synced;
 
 int get_timestamp(timestamp_t *timestamp)
 {
@@ -19,6 +39,23 @@ int get_timestamp(timestamp_t *timestamp)
     return result;
 }
 
+//Function that returns the time between two timestamps in milliseconds
+//Returns UINT32_MAX if the timestamps are not in the same month or are in the wrong order
+uint32_t timestamp_diff_ms(const timestamp_t *later, const timestamp_t *earlier)
+{
+    if((later->year != earlier->year) || (later->month != earlier->month))
+    {
+        return UINT32_MAX;
+    }
+    int64_t later_ms = ((((int64_t)later->day * 24 + later->hour) * 60 + later->minute) * 60 + later->second) * 1000 + later->hundredths * 10;
+    int64_t earlier_ms = ((((int64_t)earlier->day * 24 + earlier->hour) * 60 + earlier->minute) * 60 + earlier->second) * 1000 + earlier->hundredths * 10;
+    if(later_ms < earlier_ms)
+    {
+        return UINT32_MAX;
+    }
+    return (uint32_t)(later_ms - earlier_ms);
+}
+
 int reset_rtc()
 {
     int result = 0;
@@ -35,6 +72,7 @@ int reset_rtc()
     result += am1805_init();
     //Initialize RTC with all zeros
     result += am1805_set_datetime(&init_time);
+    rtc_synced = 0;
     return result;
 }
 
@@ -43,3 +81,272 @@ int rtc_init()
     return am1805_init();
 }
 
+//Function that sets the RTC to the time received from the base station
+//Nothing is written if the RTC is already within RTC_SYNC_MIN_OFFSET_MS
+int rtc_set_time(const timestamp_t *utc)
+{
+    int result = 0;
+    timestamp_t now;
+    result += get_timestamp(&now);
+    if((result == 0) && (timestamp_diff_ms(&now, utc) <= RTC_SYNC_MIN_OFFSET_MS || timestamp_diff_ms(utc, &now) <= RTC_SYNC_MIN_OFFSET_MS))
+    {
+        rtc_synced = 1;
+        return 0;
+    }
+    //Same field mapping as in get_timestamp
+    struct tm t =  {.tm_sec = utc->second,
+                    .tm_min = utc->minute,
+                    .tm_hour = utc->hour,
+                    .tm_mday = utc->day,
+                    .tm_mon = utc->month,
+                    .tm_year = utc->year,
+                    .tm_wday = utc->wday,
+                    .tm_yday = 0,
+                    .tm_isdst = 0};
+    result += am1805_set_datetime(&t);
+    //Hundredths are not part of struct tm, they are written last as BCD
+    result += write_rtc_register(AM1805_REG_HUNDREDTHS, (uint8_t)(((utc->hundredths / 10) << 4) | (utc->hundredths % 10)));
+    rtc_synced = (result == 0);
+    return result;
+}
+
+//Function that reports whether the RTC holds time from the base station
+//The flag is kept in RAM, after a reset the RTC counts as not synced until the next time sync ACK
+int rtc_is_synced()
+{
+    return rtc_synced;
+}
+
+//Function that adds the rate error measured by the base station to the XT calibration of the RTC
+//A positive drift means the RTC runs fast. The measured drift already includes the current calibration,
+//so the correction is accumulated. One calibration step is 1.90735 ppm (2^-19), CMDX doubles the step size
+int rtc_correct_drift(int32_t drift_ppb)
+{
+    int result = 0;
+    uint8_t calibration;
+    result += read_rtc_register(AM1805_REG_CALIBRATION_XT, &calibration);
+    if(result != 0)
+    {
+        return result;
+    }
+    //OFFSETX is a 7 bit two's complement value
+    int32_t adj = (int32_t)(calibration & 0x7F) - ((calibration & 0x40) ? 128 : 0);
+    if(calibration & AM1805_CALIBRATION_XT_CMDX)
+    {
+        adj *= 2;
+    }
+    //Convert to steps of 2^-19 and round to the nearest step
+    int64_t adj_scaled = (int64_t)adj * 1000000000 - (int64_t)drift_ppb * 524288;
+    adj = (int32_t)((adj_scaled + (adj_scaled >= 0 ? 500000000 : -500000000)) / 1000000000);
+    //Clamp to the range the RTC can compensate, -122 ppm to +240 ppm
+    if(adj < -64)
+    {
+        adj = -64;
+    }
+    else if(adj > 126)
+    {
+        adj = 126;
+    }
+    if(adj <= 63)
+    {
+        calibration = (uint8_t)(adj & 0x7F);
+    }
+    else
+    {
+        calibration = AM1805_CALIBRATION_XT_CMDX | (uint8_t)(((adj + 1) / 2) & 0x7F);
+    }
+    result += write_rtc_register(AM1805_REG_CALIBRATION_XT, calibration);
+    return result;
+}
+
+//Function that starts the countdown timer of the RTC to repeatedly signal capture slots on nIRQ
+//The timer reloads itself in hardware, so the cadence does not depend on the MCU and continues across resets.
+//A timer that already runs with the same settings is left alone to keep the phase of the slots
+int rtc_start_schedule(const rtc_schedule_cfg_t *cfg)
+{
+    int result = 0;
+    uint8_t timer_control;
+    uint8_t timer_initial;
+    uint8_t interrupt_mask;
+    uint8_t expected_control = AM1805_TIMER_CONTROL_TE | AM1805_TIMER_CONTROL_TRPT;
+    uint8_t expected_initial;
+
+    //The timer signals a slot after initial value + 1 periods of its clock
+    if(cfg->period_s <= 256)
+    {
+        expected_control |= AM1805_TIMER_CONTROL_TFS_1HZ;
+        expected_initial = (uint8_t)((cfg->period_s > 0 ? cfg->period_s : 1) - 1);
+    }
+    else
+    {
+        uint32_t minutes = cfg->period_s / 60;
+        expected_control |= AM1805_TIMER_CONTROL_TFS_1_60HZ;
+        expected_initial = (uint8_t)((minutes > 256 ? 256 : minutes) - 1);
+    }
+
+    result += read_rtc_register(AM1805_REG_TIMER_CONTROL, &timer_control);
+    result += read_rtc_register(AM1805_REG_TIMER_INITIAL, &timer_initial);
+    result += read_rtc_register(AM1805_REG_INTERRUPT_MASK, &interrupt_mask);
+    if(result != 0)
+    {
+        return result;
+    }
+    if((timer_control == expected_control) && (timer_initial == expected_initial) && (interrupt_mask & AM1805_INTERRUPT_MASK_TIE))
+    {
+        return 0;
+    }
+    //Stop the timer before it is loaded, TM = 0 keeps nIRQ low until the timer flag is cleared
+    result += write_rtc_register(AM1805_REG_TIMER_CONTROL, 0);
+    result += write_rtc_register(AM1805_REG_TIMER, expected_initial);
+    result += write_rtc_register(AM1805_REG_TIMER_INITIAL, expected_initial);
+    result += clear_timer_interrupt();
+    result += write_rtc_register(AM1805_REG_INTERRUPT_MASK, interrupt_mask | AM1805_INTERRUPT_MASK_TIE);
+    result += write_rtc_register(AM1805_REG_TIMER_CONTROL, expected_control);
+    return result;
+}
+
+//Function that stops waiting for a capture slot when the capacitor voltage gets low and notifys rtos that waiting is aborted
+static void teardown() {
+    //Disable sensing on nIRQ pin to prevent further interrupts
+    nrf_gpio_cfg_default(pin_irq);
+    //Notify RTOS that teardown function is executed and operation is aborted
+    xTaskNotifyIndexed(usr_task_handle, 1, EVT_TEARDOWN, eSetValueWithOverwrite);
+    //unregister teardown function pointer as the operation aborted
+    rtc_teardown_ptr = NULL;
+}
+
+//Function that sleeps until the next capture slot
+//A slot that passed while the device was busy or charging is dropped, so captures always start at a slot boundary.
+//The falling edge of nIRQ triggers a GPIOTE PORT event whose interrupt notifies the user task with EVT_GPIO, until
+//then the MCU stays in System ON sleep. Returns 0 at the start of a slot and -1 if waiting was aborted
+int rtc_wait_capture_slot(const rtc_schedule_cfg_t *cfg)
+{
+    unsigned long notification_value = 0;
+    int slot_reached;
+
+    if(clear_timer_interrupt() != 0)
+    {
+        return -1;
+    }
+    pin_irq = cfg->pin_irq;
+
+    taskENTER_CRITICAL();
+    //Clear all rtos notifications assigned to user task before the interrupt can occur
+    xTaskNotifyStateClearIndexed(usr_task_handle, 1);
+    //nIRQ is an open drain output, sense the low level it drives at the start of a slot
+    nrf_gpio_cfg_sense_input(cfg->pin_irq, NRF_GPIO_PIN_PULLUP, NRF_GPIO_PIN_SENSE_LOW);
+    NRF_GPIOTE->EVENTS_PORT = 0;
+    NRF_GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+    //Register teardown function pointer while operation is in progress
+    rtc_teardown_ptr = teardown;
+    taskEXIT_CRITICAL();
+
+    //The slot may have started between clearing the flag and enabling sensing
+    if (nrf_gpio_pin_read(cfg->pin_irq) == 1)
+    {
+        //Block until PORT event notification
+        xTaskNotifyWaitIndexed(1, 0xFFFFFFFF, 0xFFFFFFFF, &notification_value, portMAX_DELAY);
+    }
+    slot_reached = (notification_value != EVT_TEARDOWN) && (nrf_gpio_pin_read(cfg->pin_irq) == 0);
+
+    taskENTER_CRITICAL();
+    //Disconnect the pin, the pull-up would draw current while nIRQ is low
+    nrf_gpio_cfg_default(cfg->pin_irq);
+    //unregister teardown function pointer as the operation finished
+    rtc_teardown_ptr = NULL;
+    taskEXIT_CRITICAL();
+
+    //Release nIRQ right away instead of at the next wait
+    if(slot_reached && (clear_timer_interrupt() != 0))
+    {
+        return -1;
+    }
+    return slot_reached ? 0 : -1;
+}
+
+//Function that derives the number of skipped slots from the time between two captures
+//Returns RTC_MISSED_SLOTS_UNKNOWN if the time between the captures is not known
+uint8_t rtc_count_missed_slots(const rtc_schedule_cfg_t *cfg, uint32_t capture_interval_ms)
+{
+    if(capture_interval_ms == UINT32_MAX)
+    {
+        return RTC_MISSED_SLOTS_UNKNOWN;
+    }
+    uint32_t period_ms = cfg->period_s * 1000;
+    uint32_t slots = (capture_interval_ms + period_ms / 2) / period_ms;
+    if(slots <= 1)
+    {
+        return 0;
+    }
+    return (slots - 1) < RTC_MISSED_SLOTS_UNKNOWN ? (uint8_t)(slots - 1) : (RTC_MISSED_SLOTS_UNKNOWN - 1);
+}
+
+//Function that clears the timer flag in the status register, which releases nIRQ
+static int clear_timer_interrupt()
+{
+    //Status flags are cleared by writing 0, writing 1 leaves the other flags unchanged
+    return write_rtc_register(AM1805_REG_STATUS, (uint8_t)~AM1805_STATUS_TIM);
+}
+
+//The am1805 driver only covers date and time, the remaining registers are accessed over RTC_TWIM, the instance
+//am1805_init configured, so pins and frequency stay as the driver set them up
+static int read_rtc_register(uint8_t address, uint8_t *value)
+{
+    uint8_t tx[1] = {address};
+    return rtc_transfer(tx, 1, value, 1);
+}
+
+static int write_rtc_register(uint8_t address, uint8_t value)
+{
+    uint8_t tx[2] = {address, value};
+    return rtc_transfer(tx, 2, NULL, 0);
+}
+
+//Function that writes n_tx bytes to the RTC and reads n_rx bytes after a repeated start if n_rx is not 0
+//Only the user task talks to the RTC, so the transfer is polled with interrupts of the instance masked instead of
+//in a critical section, the driver's interrupt handler does not see it and radio and teardown keep running
+//Returns 0 on success and -1 if the RTC did not acknowledge or the transfer did not finish in RTC_TWIM_TIMEOUT_US
+static int rtc_transfer(const uint8_t *tx, uint32_t n_tx, uint8_t *rx, uint32_t n_rx)
+{
+    NRF_TWIM_Type *twim = RTC_TWIM;
+    uint32_t enable = twim->ENABLE;
+    uint32_t inten = twim->INTEN;
+    uint32_t waited_us = 0;
+    int result = 0;
+
+    twim->INTEN = 0;
+    twim->ENABLE = TWIM_ENABLE_ENABLE_Enabled << TWIM_ENABLE_ENABLE_Pos;
+    twim->ADDRESS = AM1805_I2C_ADDRESS;
+    twim->TXD.PTR = (uint32_t)tx;
+    twim->TXD.MAXCNT = n_tx;
+    twim->RXD.PTR = (uint32_t)rx;
+    twim->RXD.MAXCNT = n_rx;
+    twim->SHORTS = (n_rx > 0) ? (TWIM_SHORTS_LASTTX_STARTRX_Msk | TWIM_SHORTS_LASTRX_STOP_Msk) : TWIM_SHORTS_LASTTX_STOP_Msk;
+    twim->EVENTS_STOPPED = 0;
+    twim->EVENTS_ERROR = 0;
+    twim->ERRORSRC = twim->ERRORSRC;
+    twim->TASKS_STARTTX = 1;
+    while(!twim->EVENTS_STOPPED && (waited_us < RTC_TWIM_TIMEOUT_US))
+    {
+        if(twim->EVENTS_ERROR)
+        {
+            //A missing acknowledge does not end the transfer by itself
+            twim->EVENTS_ERROR = 0;
+            twim->TASKS_STOP = 1;
+            result = -1;
+        }
+        riotee_delay_us(1);
+        waited_us++;
+    }
+    if(!twim->EVENTS_STOPPED)
+    {
+        result = -1;
+    }
+    twim->SHORTS = 0;
+    twim->EVENTS_STOPPED = 0;
+    twim->EVENTS_ERROR = 0;
+    twim->ERRORSRC = twim->ERRORSRC;
+    twim->ENABLE = enable;
+    twim->INTEN = inten;
+    return result;
+}
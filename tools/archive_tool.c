@@ -0,0 +1,209 @@
+//Command line access to snapshot archives
+//
+//Build: make -C tools
+//Usage: tools/_build/archive_tool convert [-f MHz] [-r|-b bits] [-m 0|1] <archive> <snapshot_file>..
+//         Appends loose snapshot files as written by ingest_server -o (frame 0 followed by the samples of all data
+//         frames, file name <dev_id>_<counter>_<snapshot_id>.bin). -f, -r and -m record the max2769 configuration
+//         the devices were running with, it is stored as unknown otherwise. Files with the shorter frame 0 of older
+//         firmware are accepted. Files that cannot be read, parsed or decoded are reported and skipped, the exit
+//         status is 1 if any file was skipped.
+//       tools/_build/archive_tool list <archive> [dev_id]
+//         Prints one line per snapshot with the sampling frequency in MHz, the adc resolution in bits and the min
+//         power option as on/off. Fields that were not recorded are printed as ?.
+//       tools/_build/archive_tool scan <archive>
+//         Reads all samples in place and reports the throughput.
+
+#include <libgen.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "snapshot_archive.h"
+
+static int convert(int argc, char **argv)
+{
+  max2769_cfg_t cfg = {.sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M4,
+                       .adc_resolution = MAX2769_ADC_RESOLUTION_1B,
+                       .min_power_option = MAX2769_MIN_POWER_OPTION_DISABLE};
+  int cfg_known = 0;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:b:m:")) != -1) {
+    cfg_known = 1;
+    //-b is accepted as well, ingest_server uses it because -r selects replay files there
+    if (snapshot_archive_parse_cfg(&cfg, opt == 'b' ? 'r' : (char)opt, optarg) != 0)
+      return -1;
+  }
+  if (optind >= argc)
+    return -1;
+
+  snapshot_archive_writer_t w;
+  if (snapshot_archive_writer_open(&w, argv[optind], cfg_known ? &cfg : NULL) != 0) {
+    fprintf(stderr, "could not open archive %s\n", argv[optind]);
+    return 1;
+  }
+  uint8_t *buf = NULL;
+  size_t converted = 0;
+  size_t skipped = 0;
+  for (int i = optind + 1; i < argc; i++) {
+    char name[4096];
+    snprintf(name, sizeof(name), "%s", argv[i]);
+    unsigned long dev_id;
+    if (sscanf(basename(name), "%lu_", &dev_id) != 1) {
+      fprintf(stderr, "%s: file name does not start with a dev_id, skipped\n", argv[i]);
+      skipped++;
+      continue;
+    }
+    FILE *f = fopen(argv[i], "rb");
+    if (f == NULL) {
+      fprintf(stderr, "could not open %s\n", argv[i]);
+      skipped++;
+      continue;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    rewind(f);
+    frame_0_t frame_0;
+    uint8_t *p = length > LENGTH_FIRST_FRAME_MIN ? realloc(buf, (size_t)length) : NULL;
+    if (p == NULL || fread(p, (size_t)length, 1, f) != 1) {
+      fprintf(stderr, "%s: could not read snapshot, skipped\n", argv[i]);
+      fclose(f);
+      skipped++;
+      continue;
+    }
+    buf = p;
+    fclose(f);
+    long offset = snapshot_archive_parse_file(&frame_0, buf, (size_t)length);
+    if (offset < 0) {
+      fprintf(stderr, "%s: frame 0 does not match the file length, skipped\n", argv[i]);
+      skipped++;
+      continue;
+    }
+    //A snapshot that cannot be decoded or written is reported, the remaining files are still converted
+    if (snapshot_archive_append(&w, (uint32_t)dev_id, &frame_0, buf + offset, (uint32_t)(length - offset)) != 0) {
+      fprintf(stderr, "%s: could not append snapshot (coder %u), skipped\n", argv[i], (unsigned int)frame_0.coder);
+      skipped++;
+      continue;
+    }
+    converted++;
+  }
+  free(buf);
+  fprintf(stderr, "%zu snapshots appended, %zu files skipped\n", converted, skipped);
+  return (snapshot_archive_writer_close(&w) == 0 && skipped == 0) ? 0 : 1;
+}
+
+static const char *sampling_frequency_name(uint8_t f)
+{
+  switch (f) {
+    case MAX2769_SAMPLING_FREQUENCY_M32: return "32";
+    case MAX2769_SAMPLING_FREQUENCY_M16: return "16";
+    case MAX2769_SAMPLING_FREQUENCY_M8: return "8";
+    case MAX2769_SAMPLING_FREQUENCY_M4: return "4";
+    default: return "?";
+  }
+}
+
+static const char *adc_resolution_name(uint8_t r)
+{
+  static const char *names[] = {"1", "1.5", "2", "2.5", "3"};
+  return r < sizeof(names) / sizeof(names[0]) ? names[r] : "?";
+}
+
+static const char *min_power_option_name(uint8_t m)
+{
+  switch (m) {
+    case MAX2769_MIN_POWER_OPTION_ENABLE: return "on";
+    case MAX2769_MIN_POWER_OPTION_DISABLE: return "off";
+    default: return "?";
+  }
+}
+
+static void print_header(const snapshot_archive_t *a, const snapshot_archive_header_t *h)
+{
+  const timestamp_t *c = &h->capture_timestamp;
+  //Version 1 archives have no time_synced and missed_slots, their bytes were reserved
+  char time_synced[4] = "?", missed_slots[4] = "?";
+  if (a->version >= 2) {
+    snprintf(time_synced, sizeof(time_synced), "%u", h->time_synced);
+    if (h->missed_slots != RTC_MISSED_SLOTS_UNKNOWN)
+      snprintf(missed_slots, sizeof(missed_slots), "%u", h->missed_slots);
+  }
+  printf("%u %u %02u-%02u-%02u %02u:%02u:%02u.%02u %s %s %u %s %s %s\n", h->dev_id, h->snapshot_id, c->year,
+         c->month, c->day, c->hour, c->minute, c->second, c->hundredths, time_synced, missed_slots,
+         h->samples_length, sampling_frequency_name(h->sampling_frequency), adc_resolution_name(h->adc_resolution),
+         min_power_option_name(h->min_power_option));
+}
+
+static int list(int argc, char **argv)
+{
+  if (argc < 2 || argc > 3)
+    return -1;
+  snapshot_archive_t a;
+  if (snapshot_archive_open(&a, argv[1]) != 0) {
+    fprintf(stderr, "could not open archive %s\n", argv[1]);
+    return 1;
+  }
+  printf("dev_id snapshot_id capture_time time_synced missed_slots samples_length f_mhz adc_bits min_power\n");
+  if (argc == 3) {
+    size_t first;
+    size_t n = snapshot_archive_find(&a, (uint32_t)strtoul(argv[2], NULL, 10), 0, UINT64_MAX, &first);
+    for (size_t i = first; i < first + n; i++)
+      print_header(&a, &a.headers[a.order[i]]);
+  } else {
+    for (size_t i = 0; i < a.count; i++)
+      print_header(&a, &a.headers[a.order[i]]);
+  }
+  snapshot_archive_close(&a);
+  return 0;
+}
+
+static int scan(int argc, char **argv)
+{
+  if (argc != 2)
+    return -1;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  snapshot_archive_t a;
+  if (snapshot_archive_open(&a, argv[1]) != 0) {
+    fprintf(stderr, "could not open archive %s\n", argv[1]);
+    return 1;
+  }
+  //Count the set bits of all samples, a stand-in for the work a solver does on the data
+  uint64_t bytes = 0, ones = 0;
+  for (size_t i = 0; i < a.count; i++) {
+    const snapshot_archive_header_t *h = &a.headers[i];
+    const uint8_t *samples = snapshot_archive_samples(&a, h);
+    uint32_t k = 0;
+    //Samples start at a page boundary, so they can be read as words
+    for (; k + sizeof(uint64_t) <= h->samples_length; k += sizeof(uint64_t))
+      ones += (uint64_t)__builtin_popcountll(*(const uint64_t *)(samples + k));
+    for (; k < h->samples_length; k++)
+      ones += (uint64_t)__builtin_popcount(samples[k]);
+    bytes += h->samples_length;
+  }
+  size_t count = a.count;
+  snapshot_archive_close(&a);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  printf("%zu snapshots, %.1f MB in %.3f s (%.0f MB/s), share of ones %.4f\n", count, bytes / 1e6, seconds,
+         bytes / 1e6 / seconds, bytes ? (double)ones / (8.0 * bytes) : 0.0);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  int result = -1;
+  if (argc >= 2 && strcmp(argv[1], "convert") == 0)
+    result = convert(argc - 1, argv + 1);
+  else if (argc >= 2 && strcmp(argv[1], "list") == 0)
+    result = list(argc - 1, argv + 1);
+  else if (argc >= 2 && strcmp(argv[1], "scan") == 0)
+    result = scan(argc - 1, argv + 1);
+  if (result < 0) {
+    fprintf(stderr, "usage: %s convert [-f MHz] [-r|-b bits] [-m 0|1] <archive> <snapshot_file>..\n"
+                    "       %s list <archive> [dev_id]\n"
+                    "       %s scan <archive>\n", argv[0], argv[0], argv[0]);
+    return 1;
+  }
+  return result;
+}
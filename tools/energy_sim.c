@@ -0,0 +1,556 @@
+//Host side energy trace replay simulator for the snapshot firmware
+//
+//The simulator replays a recorded or synthetic harvesting trace against a model of the main loop in src/main.c:
+//wait until the capacitor is charged, power up and configure the max2769, capture a snapshot over SPIS and send it
+//as a sequence of stella frames. Whenever the capacitor voltage drops below the turn-off threshold the firmware's
+//turnoff_callback is modelled: the running operation is aborted, the device sleeps until the capacitor is charged
+//again and the operation is repeated (a brown-out during the capture restarts the whole capture).
+//
+//Build: make -C tools
+//Usage: tools/_build/energy_sim [options] <trace>
+//  <trace> is either a csv file with lines "time_s,power_W" (power is constant until the next line, the last line
+//  marks the end of the trace) or a synthetic trace "const:<W>" or "square:<W_high>,<W_low>,<period_s>,<duty>".
+//  Every configuration option accepts a comma separated list, all combinations are simulated in parallel.
+//  -f  sampling frequency in MHz (4, 8, 16, 32)          default 4
+//  -r  adc resolution in bits (1, 1.5, 2, 2.5, 3)        default 1
+//  -m  min power option (0: disabled, 1: enabled)       default 0
+//  -d  snapshot duration in ms                          default 12
+//  -p  snapshot bytes per frame                         default SNAPSHOT_BYTES_PER_FRAME
+//  -l  probability that a frame or its ACK is lost      default 0
+//  -C  capacitance in F, -V v_max,v_on,v_off in V, -e harvester efficiency, -T duration of synthetic traces in h
+//  -j  number of worker threads                         default number of cpus
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "max2769.h"
+#include "snapshot_frame.h"
+
+#define MAX_LIST_ENTRIES 16
+#define MAX_RETRANSMISSIONS 20          //same value as used by the firmware for riotee_stella_verified_transmission
+
+//Stages of the firmware main loop in which a brown-out can happen
+typedef enum {
+  STAGE_POWERUP,        //waiting for PLL lock after enable_max2769 and after configure_max2769
+  STAGE_CONFIGURE,      //SPIC register writes in configure_max2769
+  STAGE_CAPTURE,        //get_timestamp and SPIS reception of the snapshot
+  STAGE_FIRST_FRAME,    //take_timestamp_and_send_first_frame
+  STAGE_DATA_FRAMES,    //send_snapshot_data_frame
+  NUMBER_OF_STAGES
+} stage_t;
+
+static const char *stage_names[NUMBER_OF_STAGES] = {"powerup", "configure", "capture", "frame0", "frames"};
+
+//Storage capacitor and supply thresholds of the Riotee device
+typedef struct {
+  double capacitance;       //F
+  double v_max;             //V, capacitor voltage is clamped by the harvester at this value
+  double v_on;              //V, riotee_wait_cap_charged returns above this value
+  double v_off;             //V, turnoff_callback is called below this value
+  double efficiency;        //share of the harvested power that ends up in the capacitor
+} capacitor_model_t;
+
+//Power and timing of the individual operations. Power values are taken from the component datasheets
+//for a 3V supply and should be replaced by measured values whenever they are available.
+typedef struct {
+  double p_sleep;               //W, nRF52 sleeping, max2769 off
+  double p_mcu_active;          //W, nRF52 running from RAM
+  double p_max2769;             //W, max2769 active with default register values
+  double p_max2769_min_power;   //W, max2769 active with MAX2769_MIN_POWER_OPTION_ENABLE
+  double t_powerup;             //s, PLL lock time after enable_max2769 and after configure_max2769
+  double t_spic_write;          //s, one 32 bit register write at SPIC_FREQUENCY_K125
+  double t_timestamp;           //s, reading the AM1805 over I2C
+  double p_radio_tx;            //W, radio sending incl. cpu
+  double p_radio_rx;            //W, radio waiting for ACK incl. cpu
+  double t_radio_rampup;        //s, per transceive
+  double t_ack_window;          //s, listening for the ACK
+  double bitrate;               //bit/s on air
+  unsigned int pkt_overhead;    //bytes on air in addition to the stella payload
+} energy_model_t;
+
+typedef struct {
+  double *time;             //s, start of each segment
+  double *power;            //W, harvested power during each segment
+  size_t n;                 //number of segment boundaries, the last one marks the end of the trace
+} trace_t;
+
+//One configuration to be simulated
+typedef struct {
+  max2769_cfg_t max2769_cfg;
+  double snapshot_duration_ms;
+  unsigned int bytes_per_frame;
+  double loss_probability;
+} sim_job_t;
+
+typedef struct {
+  unsigned long snapshots_delivered;
+  unsigned long snapshots_incomplete;
+  unsigned long frames_sent;
+  unsigned long transmissions;
+  unsigned long brownouts[NUMBER_OF_STAGES];
+  double latency_sum;       //s, from capture to last ACK for delivered snapshots
+  double simulated_time;    //s
+} sim_result_t;
+
+//State of a running simulation
+typedef struct {
+  const trace_t *trace;
+  const capacitor_model_t *cap;
+  const energy_model_t *model;
+  size_t cursor;            //trace segment that contains t
+  double t;                 //s
+  double energy;            //J stored above 0V
+  double e_max;
+  double e_on;
+  double e_off;
+  uint64_t rng;
+  int trace_ended;
+} sim_state_t;
+
+static capacitor_model_t cap_model = {.capacitance = 470e-6,
+                                      .v_max = 4.8,
+                                      .v_on = 4.0,
+                                      .v_off = 3.0,
+                                      .efficiency = 0.8};
+
+static const energy_model_t energy_model = {.p_sleep = 10e-6,
+                                            .p_mcu_active = 3.0 * 3.3e-3,
+                                            .p_max2769 = 3.0 * 18e-3,
+                                            .p_max2769_min_power = 3.0 * 11e-3,
+                                            .t_powerup = 1e-3,
+                                            .t_spic_write = 32.0 / 125e3,
+                                            .t_timestamp = 0.5e-3,
+                                            .p_radio_tx = 3.0 * 7.5e-3,
+                                            .p_radio_rx = 3.0 * 7.0e-3,
+                                            .t_radio_rampup = 140e-6,
+                                            .t_ack_window = 500e-6,
+                                            .bitrate = 1e6,
+                                            .pkt_overhead = 16};
+
+static double sampling_frequency_hz(max2769_sampling_frequency_t f)
+{
+  switch (f) {
+    case MAX2769_SAMPLING_FREQUENCY_M32: return 32.736e6;
+    case MAX2769_SAMPLING_FREQUENCY_M16: return 16.368e6;
+    case MAX2769_SAMPLING_FREQUENCY_M8: return 8.184e6;
+    default: return 4.092e6;
+  }
+}
+
+//Number of bits the max2769 shifts out per sample for a given adc resolution (I channel only)
+static unsigned int bits_per_sample(max2769_adc_resolution_t r)
+{
+  switch (r) {
+    case MAX2769_ADC_RESOLUTION_1B: return 1;
+    case MAX2769_ADC_RESOLUTION_1B5:
+    case MAX2769_ADC_RESOLUTION_2B: return 2;
+    default: return 3;
+  }
+}
+
+//Number of register writes done by configure_max2769 for a configuration
+static unsigned int number_of_spic_writes(const max2769_cfg_t *cfg)
+{
+  //set_sampling_frequency and set_adc_resolution
+  unsigned int writes = 2;
+  //reduce_* functions, select_3order_butfilter and disable_antenna_bias
+  if (cfg->min_power_option == MAX2769_MIN_POWER_OPTION_ENABLE)
+    writes += 8;
+  return writes;
+}
+
+static double random_uniform(sim_state_t *s)
+{
+  //xorshift64*
+  s->rng ^= s->rng >> 12;
+  s->rng ^= s->rng << 25;
+  s->rng ^= s->rng >> 27;
+  return (double)((s->rng * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+//Returns the net power flowing into the capacitor during the current segment while consuming p_load
+static double net_power(const sim_state_t *s, double p_load)
+{
+  return s->trace->power[s->cursor] * s->cap->efficiency - p_load;
+}
+
+//Advances the simulation by dt while consuming p_load. Returns the time at which the capacitor voltage dropped
+//below v_off or a negative value if the device stayed powered.
+static double advance(sim_state_t *s, double dt, double p_load)
+{
+  double t_end = s->t + dt;
+  while (s->t < t_end) {
+    if (s->cursor + 1 >= s->trace->n) {
+      s->trace_ended = 1;
+      return -1.0;
+    }
+    double seg_end = s->trace->time[s->cursor + 1];
+    double step = (seg_end < t_end ? seg_end : t_end) - s->t;
+    double p = net_power(s, p_load);
+    double e = s->energy + p * step;
+    if (e < s->e_off) {
+      double t_brownout = s->t + (s->energy - s->e_off) / -p;
+      s->t = t_brownout;
+      s->energy = s->e_off;
+      return t_brownout;
+    }
+    s->energy = e > s->e_max ? s->e_max : e;
+    s->t += step;
+    if (s->t >= seg_end)
+      s->cursor++;
+  }
+  return -1.0;
+}
+
+//Models riotee_wait_cap_charged: sleep until the capacitor holds e_on
+static void wait_cap_charged(sim_state_t *s)
+{
+  while (s->energy < s->e_on) {
+    if (s->cursor + 1 >= s->trace->n) {
+      s->trace_ended = 1;
+      return;
+    }
+    double seg_end = s->trace->time[s->cursor + 1];
+    double p = net_power(s, s->model->p_sleep);
+    double step = seg_end - s->t;
+    if (p > 0.0 && s->energy + p * step >= s->e_on)
+      step = (s->e_on - s->energy) / p;
+    //Leakage while sleeping may discharge the capacitor but the device is already off, so no brown-out is counted
+    s->energy += p * step;
+    if (s->energy < 0.0)
+      s->energy = 0.0;
+    s->t += step;
+    if (s->t >= seg_end)
+      s->cursor++;
+  }
+}
+
+//Runs one operation and handles a brown-out the way the Riotee runtime does. Returns 0 on success.
+static int run_operation(sim_state_t *s, sim_result_t *r, stage_t stage, double dt, double p_load)
+{
+  if (advance(s, dt, p_load) < 0.0)
+    return s->trace_ended ? -1 : 0;
+  r->brownouts[stage]++;
+  wait_cap_charged(s);
+  return -1;
+}
+
+//Models get_timestamped_snapshot, returns 0 if the snapshot was captured without brown-out
+static int capture_snapshot(sim_state_t *s, sim_result_t *r, const sim_job_t *job)
+{
+  const max2769_cfg_t *cfg = &job->max2769_cfg;
+  const energy_model_t *m = s->model;
+  double p_max2769 = cfg->min_power_option == MAX2769_MIN_POWER_OPTION_ENABLE ? m->p_max2769_min_power : m->p_max2769;
+  double t_spis = cfg->snapshot_size_bytes * 8.0 /
+                  (sampling_frequency_hz(cfg->sampling_frequency) * bits_per_sample(cfg->adc_resolution));
+
+  if (run_operation(s, r, STAGE_POWERUP, m->t_powerup, p_max2769 + m->p_sleep))
+    return -1;
+  if (run_operation(s, r, STAGE_CONFIGURE, number_of_spic_writes(cfg) * m->t_spic_write, p_max2769 + m->p_mcu_active))
+    return -1;
+  if (run_operation(s, r, STAGE_POWERUP, m->t_powerup, p_max2769 + m->p_sleep))
+    return -1;
+  if (run_operation(s, r, STAGE_CAPTURE, m->t_timestamp + t_spis, p_max2769 + m->p_mcu_active))
+    return -1;
+  return 0;
+}
+
+//Models riotee_stella_verified_transmission, returns 0 if the frame was acknowledged
+static int transmit_frame(sim_state_t *s, sim_result_t *r, const sim_job_t *job, stage_t stage, unsigned int length)
+{
+  const energy_model_t *m = s->model;
+  double t_air = (length + m->pkt_overhead) * 8.0 / m->bitrate;
+  double e_attempt = m->t_radio_rampup * m->p_radio_rx + t_air * m->p_radio_tx + m->t_ack_window * m->p_radio_rx;
+  double t_attempt = m->t_radio_rampup + t_air + m->t_ack_window;
+
+  r->frames_sent++;
+  for (int attempt = 0; attempt <= MAX_RETRANSMISSIONS; attempt++) {
+    //A brown-out restarts the transceive after the capacitor has been recharged
+    while (run_operation(s, r, stage, t_attempt, e_attempt / t_attempt)) {
+      if (s->trace_ended)
+        return -1;
+    }
+    r->transmissions++;
+    if (random_uniform(s) >= job->loss_probability)
+      return 0;
+  }
+  return -1;
+}
+
+static void simulate(const trace_t *trace, const sim_job_t *job, uint64_t seed, sim_result_t *r)
+{
+  sim_state_t s = {.trace = trace, .cap = &cap_model, .model = &energy_model, .cursor = 0, .t = trace->time[0],
+                   .energy = 0.0, .rng = seed | 1, .trace_ended = 0};
+  s.e_max = 0.5 * cap_model.capacitance * cap_model.v_max * cap_model.v_max;
+  s.e_on = 0.5 * cap_model.capacitance * cap_model.v_on * cap_model.v_on;
+  s.e_off = 0.5 * cap_model.capacitance * cap_model.v_off * cap_model.v_off;
+
+  unsigned int bytes = job->max2769_cfg.snapshot_size_bytes;
+  unsigned int data_frames = (bytes + job->bytes_per_frame - 1) / job->bytes_per_frame;
+
+  memset(r, 0, sizeof(*r));
+  while (!s.trace_ended) {
+    wait_cap_charged(&s);
+    if (capture_snapshot(&s, r, job))
+      continue;
+    double t_capture = s.t;
+    int complete = 1;
+    wait_cap_charged(&s);
+    if (transmit_frame(&s, r, job, STAGE_FIRST_FRAME, LENGTH_FIRST_FRAME))
+      complete = 0;
+    for (unsigned int frame = 1; frame <= data_frames && !s.trace_ended; frame++) {
+      unsigned int payload = frame < data_frames ? job->bytes_per_frame : bytes - (data_frames - 1) * job->bytes_per_frame;
+      wait_cap_charged(&s);
+      if (transmit_frame(&s, r, job, STAGE_DATA_FRAMES, payload + LENGTH_FRAME_HEADER))
+        complete = 0;
+    }
+    if (s.trace_ended)
+      break;
+    if (complete) {
+      r->snapshots_delivered++;
+      r->latency_sum += s.t - t_capture;
+    } else {
+      r->snapshots_incomplete++;
+    }
+  }
+  r->simulated_time = s.t - trace->time[0];
+}
+
+static int trace_append(trace_t *trace, size_t *capacity, double time, double power)
+{
+  if (trace->n == *capacity) {
+    *capacity = *capacity ? 2 * *capacity : 1024;
+    double *t = realloc(trace->time, *capacity * sizeof(double));
+    double *p = realloc(trace->power, *capacity * sizeof(double));
+    if (t == NULL || p == NULL)
+      return -1;
+    trace->time = t;
+    trace->power = p;
+  }
+  if (trace->n > 0 && time <= trace->time[trace->n - 1])
+    return -1;
+  trace->time[trace->n] = time;
+  trace->power[trace->n] = power;
+  trace->n++;
+  return 0;
+}
+
+static int load_trace(const char *spec, double duration_h, trace_t *trace)
+{
+  size_t capacity = 0;
+  double duration = duration_h * 3600.0;
+  double a, b, period, duty;
+
+  memset(trace, 0, sizeof(*trace));
+  if (sscanf(spec, "const:%lf", &a) == 1) {
+    if (trace_append(trace, &capacity, 0.0, a) || trace_append(trace, &capacity, duration, 0.0))
+      return -1;
+    return 0;
+  }
+  if (sscanf(spec, "square:%lf,%lf,%lf,%lf", &a, &b, &period, &duty) == 4) {
+    if (period <= 0.0 || duty <= 0.0 || duty >= 1.0)
+      return -1;
+    for (double t = 0.0; t < duration; t += period) {
+      if (trace_append(trace, &capacity, t, a) || trace_append(trace, &capacity, t + duty * period, b))
+        return -1;
+    }
+    return trace_append(trace, &capacity, duration, 0.0);
+  }
+
+  FILE *f = fopen(spec, "r");
+  if (f == NULL)
+    return -1;
+  char line[256];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%lf,%lf", &a, &b) != 2)
+      continue;
+    if (trace_append(trace, &capacity, a, b)) {
+      fclose(f);
+      return -1;
+    }
+  }
+  fclose(f);
+  return trace->n >= 2 ? 0 : -1;
+}
+
+static int parse_list(const char *arg, double *values)
+{
+  int n = 0;
+  char *end;
+  while (n < MAX_LIST_ENTRIES) {
+    values[n++] = strtod(arg, &end);
+    if (end == arg)
+      return -1;
+    if (*end != ',')
+      break;
+    arg = end + 1;
+  }
+  return n;
+}
+
+static int to_sampling_frequency(double mhz, max2769_sampling_frequency_t *f)
+{
+  switch ((int)mhz) {
+    case 4: *f = MAX2769_SAMPLING_FREQUENCY_M4; return 0;
+    case 8: *f = MAX2769_SAMPLING_FREQUENCY_M8; return 0;
+    case 16: *f = MAX2769_SAMPLING_FREQUENCY_M16; return 0;
+    case 32: *f = MAX2769_SAMPLING_FREQUENCY_M32; return 0;
+    default: return -1;
+  }
+}
+
+static int to_adc_resolution(double bits, max2769_adc_resolution_t *r)
+{
+  int half_bits = (int)(bits * 2.0 + 0.5);
+  if (half_bits < 2 || half_bits > 6)
+    return -1;
+  *r = (max2769_adc_resolution_t)(half_bits - 2);
+  return 0;
+}
+
+static const char *adc_resolution_name(max2769_adc_resolution_t r)
+{
+  static const char *names[] = {"1", "1.5", "2", "2.5", "3"};
+  return names[r];
+}
+
+typedef struct {
+  const trace_t *trace;
+  const sim_job_t *jobs;
+  sim_result_t *results;
+  size_t n_jobs;
+  atomic_size_t next_job;
+} worker_ctx_t;
+
+static void *worker(void *arg)
+{
+  worker_ctx_t *ctx = arg;
+  size_t i;
+  while ((i = atomic_fetch_add(&ctx->next_job, 1)) < ctx->n_jobs)
+    simulate(ctx->trace, &ctx->jobs[i], 0x9E3779B97F4A7C15ULL * (i + 1), &ctx->results[i]);
+  return NULL;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-f MHz,..] [-r bits,..] [-m 0|1,..] [-d ms,..] [-p bytes,..] [-l p,..]\n"
+                  "       [-C F] [-V v_max,v_on,v_off] [-e efficiency] [-T hours] [-j threads] <trace>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  double freq[MAX_LIST_ENTRIES] = {4}, res[MAX_LIST_ENTRIES] = {1}, minp[MAX_LIST_ENTRIES] = {0};
+  double dur[MAX_LIST_ENTRIES] = {12}, bpf[MAX_LIST_ENTRIES] = {SNAPSHOT_BYTES_PER_FRAME}, loss[MAX_LIST_ENTRIES] = {0};
+  int n_freq = 1, n_res = 1, n_minp = 1, n_dur = 1, n_bpf = 1, n_loss = 1;
+  double duration_h = 24.0;
+  long threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:r:m:d:p:l:C:V:e:T:j:h")) != -1) {
+    switch (opt) {
+      case 'f': n_freq = parse_list(optarg, freq); break;
+      case 'r': n_res = parse_list(optarg, res); break;
+      case 'm': n_minp = parse_list(optarg, minp); break;
+      case 'd': n_dur = parse_list(optarg, dur); break;
+      case 'p': n_bpf = parse_list(optarg, bpf); break;
+      case 'l': n_loss = parse_list(optarg, loss); break;
+      case 'C': cap_model.capacitance = strtod(optarg, NULL); break;
+      case 'V':
+        if (sscanf(optarg, "%lf,%lf,%lf", &cap_model.v_max, &cap_model.v_on, &cap_model.v_off) != 3) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      case 'e': cap_model.efficiency = strtod(optarg, NULL); break;
+      case 'T': duration_h = strtod(optarg, NULL); break;
+      case 'j': threads = strtol(optarg, NULL, 10); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (optind != argc - 1 || n_freq < 0 || n_res < 0 || n_minp < 0 || n_dur < 0 || n_bpf < 0 || n_loss < 0 ||
+      threads < 1 || !(cap_model.v_off < cap_model.v_on && cap_model.v_on <= cap_model.v_max)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  trace_t trace;
+  if (load_trace(argv[optind], duration_h, &trace)) {
+    fprintf(stderr, "could not load trace %s\n", argv[optind]);
+    return 1;
+  }
+
+  //Build the cartesian product of all configuration lists
+  size_t n_jobs = (size_t)n_freq * n_res * n_minp * n_dur * n_bpf * n_loss;
+  sim_job_t *jobs = calloc(n_jobs, sizeof(sim_job_t));
+  sim_result_t *results = calloc(n_jobs, sizeof(sim_result_t));
+  if (jobs == NULL || results == NULL)
+    return 1;
+  size_t i = 0;
+  for (int a = 0; a < n_freq; a++)
+    for (int b = 0; b < n_res; b++)
+      for (int c = 0; c < n_minp; c++)
+        for (int d = 0; d < n_dur; d++)
+          for (int e = 0; e < n_bpf; e++)
+            for (int f = 0; f < n_loss; f++, i++) {
+              max2769_cfg_t *cfg = &jobs[i].max2769_cfg;
+              if (to_sampling_frequency(freq[a], &cfg->sampling_frequency) ||
+                  to_adc_resolution(res[b], &cfg->adc_resolution) || bpf[e] < 1 ||
+                  bpf[e] > SNAPSHOT_BYTES_PER_FRAME) {
+                fprintf(stderr, "invalid configuration\n");
+                return 1;
+              }
+              cfg->min_power_option = minp[c] != 0 ? MAX2769_MIN_POWER_OPTION_ENABLE : MAX2769_MIN_POWER_OPTION_DISABLE;
+              cfg->snapshot_size_bytes = (unsigned int)(sampling_frequency_hz(cfg->sampling_frequency) * dur[d] * 1e-3 *
+                                                        bits_per_sample(cfg->adc_resolution) / 8.0);
+              jobs[i].snapshot_duration_ms = dur[d];
+              jobs[i].bytes_per_frame = (unsigned int)bpf[e];
+              jobs[i].loss_probability = loss[f];
+            }
+
+  worker_ctx_t ctx = {.trace = &trace, .jobs = jobs, .results = results, .n_jobs = n_jobs};
+  atomic_init(&ctx.next_job, 0);
+  if ((size_t)threads > n_jobs)
+    threads = (long)n_jobs;
+  pthread_t *tids = calloc((size_t)threads, sizeof(pthread_t));
+  for (long t = 0; t < threads; t++) {
+    if (pthread_create(&tids[t], NULL, worker, &ctx) != 0) {
+      fprintf(stderr, "pthread_create: %s\n", strerror(errno));
+      return 1;
+    }
+  }
+  for (long t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+
+  printf("f_mhz,adc_bits,min_power,duration_ms,snapshot_bytes,bytes_per_frame,loss,snapshots_per_hour,"
+         "incomplete_per_hour,mean_latency_s,transmissions_per_frame");
+  for (int st = 0; st < NUMBER_OF_STAGES; st++)
+    printf(",brownouts_%s", stage_names[st]);
+  printf("\n");
+  for (i = 0; i < n_jobs; i++) {
+    const sim_job_t *j = &jobs[i];
+    const sim_result_t *r = &results[i];
+    double hours = r->simulated_time / 3600.0;
+    printf("%.3f,%s,%d,%.1f,%u,%u,%.3f,%.2f,%.2f,%.3f,%.3f", sampling_frequency_hz(j->max2769_cfg.sampling_frequency) * 1e-6,
+           adc_resolution_name(j->max2769_cfg.adc_resolution),
+           j->max2769_cfg.min_power_option == MAX2769_MIN_POWER_OPTION_ENABLE, j->snapshot_duration_ms,
+           j->max2769_cfg.snapshot_size_bytes, j->bytes_per_frame, j->loss_probability,
+           hours > 0.0 ? r->snapshots_delivered / hours : 0.0, hours > 0.0 ? r->snapshots_incomplete / hours : 0.0,
+           r->snapshots_delivered ? r->latency_sum / r->snapshots_delivered : 0.0,
+           r->frames_sent ? (double)r->transmissions / r->frames_sent : 0.0);
+    for (int st = 0; st < NUMBER_OF_STAGES; st++)
+      printf(",%lu", r->brownouts[st]);
+    printf("\n");
+  }
+
+  free(tids);
+  free(jobs);
+  free(results);
+  free(trace.time);
+  free(trace.power);
+  return 0;
+}
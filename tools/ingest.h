@@ -0,0 +1,44 @@
+#ifndef __INGEST_H_
+#define __INGEST_H_
+
+#include <stdint.h>
+#include <string.h>
+
+//Record format shared by ingest_server and ingest_loadgen
+//Every stella packet that the base station receives is forwarded as one record: the device id taken from the
+//stella packet header followed by the length and the content of the stella payload (one snapshot frame).
+//Records are sent as single datagrams over a unix socket or stored back to back in replay files.
+//All fields are little endian.
+
+#define INGEST_RECORD_HEADER_LENGTH 6
+#define INGEST_MAX_PAYLOAD_LENGTH 255
+#define INGEST_MAX_RECORD_LENGTH (INGEST_RECORD_HEADER_LENGTH + INGEST_MAX_PAYLOAD_LENGTH)
+
+typedef struct {
+  uint32_t dev_id;
+  uint16_t length;
+  uint8_t payload[INGEST_MAX_PAYLOAD_LENGTH];
+} ingest_record_t;
+
+//Writes a record to buf and returns the number of bytes used
+static inline size_t ingest_record_encode(const ingest_record_t *rec, uint8_t *buf)
+{
+  buf[0] = (uint8_t)rec->dev_id;
+  buf[1] = (uint8_t)(rec->dev_id >> 8);
+  buf[2] = (uint8_t)(rec->dev_id >> 16);
+  buf[3] = (uint8_t)(rec->dev_id >> 24);
+  buf[4] = (uint8_t)rec->length;
+  buf[5] = (uint8_t)(rec->length >> 8);
+  memcpy(buf + INGEST_RECORD_HEADER_LENGTH, rec->payload, rec->length);
+  return INGEST_RECORD_HEADER_LENGTH + rec->length;
+}
+
+//Parses the record header in buf, returns -1 if the length field is invalid
+static inline int ingest_record_decode_header(const uint8_t *buf, ingest_record_t *rec)
+{
+  rec->dev_id = (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+  rec->length = (uint16_t)(buf[4] | (buf[5] << 8));
+  return rec->length <= INGEST_MAX_PAYLOAD_LENGTH ? 0 : -1;
+}
+
+#endif /* __INGEST_H_ */
@@ -0,0 +1,250 @@
+//Load generator for ingest_server
+//
+//Emulates a fleet of devices running the snapshot firmware. Every device sends its snapshots as frame 0 followed by
+//the data frames, the frames of all devices are interleaved as they would arrive at a base station serving all of
+//them at once. Retransmissions after a lost ACK show up as duplicates, frames whose retransmissions all failed are
+//missing at the receiver.
+//Frame 0 carries what the firmware reports: missed_slots is unknown for the first snapshot after a reset and counts
+//randomly skipped slots afterwards, time_synced is set from the second snapshot on, as if the ACK of the first
+//frame 0 carried a time sync. A share of the snapshots holds 2 bit samples that are sent coded like the firmware does
+//with CODE_MAGNITUDE_BITS. A device that resets starts counting snapshot ids at 0 again while its RTC keeps running.
+//
+//Build: make -C tools
+//Usage: tools/_build/ingest_loadgen -n devices [-i first_dev_id] [-k snapshots] [-u dup_prob] [-x drop_prob]
+//                                   [-c coded_share] [-e reset_prob] [-R frames_per_s] (-o replay_file | -s socket)
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "ingest.h"
+#include "mag_coder.h"
+#include "prbs.h"
+#include "snapshot_frame.h"
+
+//Share of 2 bit samples with the magnitude bit set, the AGC target of the default GAINREF (170 of 512)
+#define MAGNITUDE_SHARE 0.33
+//Probability that a capture slot is skipped before a snapshot
+#define MISSED_SLOT_PROB 0.2
+
+//State of one emulated device
+typedef struct {
+  uint16_t snapshot_id;                 //restarts at 0 after a reset
+  uint8_t time_synced;
+  uint8_t missed_slots;
+  uint8_t coder;
+  uint32_t payload_length;              //length of the samples or of the coded stream
+  uint8_t samples[SNAPSHOT_SIZE_BYTES];
+  uint8_t payload[SNAPSHOT_SIZE_BYTES];
+} device_t;
+
+static uint64_t rng_state = 0x853C49E6748FEA9BULL;
+
+static double random_uniform(void)
+{
+  //xorshift64*
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (double)((rng_state * 0x2545F4914F6CDD1DULL) >> 11) / 9007199254740992.0;
+}
+
+static FILE *out_file;
+static int out_socket = -1;
+static struct sockaddr_un out_addr = {.sun_family = AF_UNIX};
+
+static int emit(const ingest_record_t *rec)
+{
+  uint8_t buf[INGEST_MAX_RECORD_LENGTH];
+  size_t n = ingest_record_encode(rec, buf);
+  if (out_file != NULL)
+    return fwrite(buf, n, 1, out_file) == 1 ? 0 : -1;
+  while (sendto(out_socket, buf, n, 0, (struct sockaddr *)&out_addr, sizeof(out_addr)) < 0) {
+    //The server's receive buffer is full, give it some time to catch up
+    if (errno != ENOBUFS && errno != EAGAIN)
+      return -1;
+    nanosleep(&(struct timespec){.tv_sec = 0, .tv_nsec = 10000}, NULL);
+  }
+  return 0;
+}
+
+//Captures the next snapshot of a device, coded snapshots hold 2 bit samples in sign/magnitude format
+static void capture(device_t *dev, uint8_t prbs_seed, int coded)
+{
+  prbs_gen(dev->samples, SNAPSHOT_SIZE_BYTES, prbs_seed);
+  dev->coder = MAG_CODER_NONE;
+  dev->payload_length = SNAPSHOT_SIZE_BYTES;
+  if (coded) {
+    //Keep the prbs bits as sign bits and draw every magnitude bit
+    for (size_t i = 0; i < SNAPSHOT_SIZE_BYTES; i++)
+      for (int bit = 6; bit >= 0; bit -= 2) {
+        if (random_uniform() < MAGNITUDE_SHARE)
+          dev->samples[i] |= (uint8_t)(1 << bit);
+        else
+          dev->samples[i] &= (uint8_t)~(1 << bit);
+      }
+    //Like the firmware, a snapshot the coder cannot shrink is sent raw
+    uint32_t coded_length = mag_coder_encode(dev->samples, SNAPSHOT_SIZE_BYTES, 2, dev->payload, SNAPSHOT_SIZE_BYTES);
+    if (coded_length > 0) {
+      dev->coder = MAG_CODER_RANGE;
+      dev->payload_length = coded_length;
+    }
+  }
+  if (dev->coder == MAG_CODER_NONE)
+    memcpy(dev->payload, dev->samples, SNAPSHOT_SIZE_BYTES);
+}
+
+//Builds the stella payload of a frame the same way the firmware does, the capture time follows from the round so
+//it keeps advancing across resets
+static void build_frame(ingest_record_t *rec, uint32_t dev_id, const device_t *dev, unsigned long round,
+                        uint16_t frame_number)
+{
+  rec->dev_id = dev_id;
+  if (frame_number == 0) {
+    frame_0_t frame_0 = {.snapshot_id = dev->snapshot_id,
+                         .frame_number = 0,
+                         .total_number_frames = SNAPSHOT_NUMBER_FRAMES(dev->payload_length),
+                         .bytes_per_frame = SNAPSHOT_BYTES_PER_FRAME,
+                         .bytes_last_frame = SNAPSHOT_BYTES_LAST_FRAME_OF(dev->payload_length),
+                         .time_synced = dev->time_synced,
+                         .missed_slots = dev->missed_slots,
+                         .coder = dev->coder};
+    frame_0.capture_timestamp.second = (uint8_t)(round % 60);
+    frame_0.capture_timestamp.minute = (uint8_t)((round / 60) % 60);
+    frame_0.capture_timestamp.hour = (uint8_t)((round / 3600) % 24);
+    frame_0.transmit_timestamp = frame_0.capture_timestamp;
+    frame_0.transmit_timestamp.hundredths = 50;
+    memcpy(rec->payload, &frame_0, LENGTH_FIRST_FRAME);
+    rec->length = LENGTH_FIRST_FRAME;
+    return;
+  }
+  size_t length = frame_number == SNAPSHOT_NUMBER_FRAMES(dev->payload_length) - 1
+                      ? SNAPSHOT_BYTES_LAST_FRAME_OF(dev->payload_length) : SNAPSHOT_BYTES_PER_FRAME;
+  memcpy(rec->payload + OFFSET_SNAPSHOT_ID, &dev->snapshot_id, LENGTH_SNAPSHOT_ID);
+  memcpy(rec->payload + OFFSET_FRAME_NUMBER, &frame_number, LENGTH_FRAME_NUMBER);
+  memcpy(rec->payload + OFFSET_SNAPSHOT_SAMPLES, dev->payload + (size_t)(frame_number - 1) * SNAPSHOT_BYTES_PER_FRAME,
+         length);
+  rec->length = (uint16_t)(LENGTH_FRAME_HEADER + length);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s -n devices [-i first_dev_id] [-k snapshots] [-u dup_prob] [-x drop_prob]\n"
+                  "       [-c coded_share] [-e reset_prob] [-R frames_per_s] (-o replay_file | -s socket)\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  unsigned long devices = 0, first_dev_id = 1, snapshots = 10;
+  double dup_prob = 0.0, drop_prob = 0.0, coded_share = 0.0, reset_prob = 0.0, rate = 0.0;
+  const char *out_path = NULL, *socket_path = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:i:k:u:x:c:e:R:o:s:h")) != -1) {
+    switch (opt) {
+      case 'n': devices = strtoul(optarg, NULL, 10); break;
+      case 'i': first_dev_id = strtoul(optarg, NULL, 10); break;
+      case 'k': snapshots = strtoul(optarg, NULL, 10); break;
+      case 'u': dup_prob = strtod(optarg, NULL); break;
+      case 'x': drop_prob = strtod(optarg, NULL); break;
+      case 'c': coded_share = strtod(optarg, NULL); break;
+      case 'e': reset_prob = strtod(optarg, NULL); break;
+      case 'R': rate = strtod(optarg, NULL); break;
+      case 'o': out_path = optarg; break;
+      case 's': socket_path = optarg; break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (devices == 0 || (out_path == NULL) == (socket_path == NULL) || optind != argc) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (out_path != NULL) {
+    out_file = fopen(out_path, "wb");
+    if (out_file == NULL) {
+      fprintf(stderr, "could not open %s: %s\n", out_path, strerror(errno));
+      return 1;
+    }
+  } else {
+    out_socket = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (out_socket < 0 || strlen(socket_path) >= sizeof(out_addr.sun_path)) {
+      fprintf(stderr, "could not create socket\n");
+      return 1;
+    }
+    strcpy(out_addr.sun_path, socket_path);
+  }
+
+  device_t *devs = calloc(devices, sizeof(device_t));
+  if (devs == NULL)
+    return 1;
+
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  unsigned long long records = 0;
+  ingest_record_t rec;
+  for (unsigned long k = 0; k < snapshots; k++) {
+    for (unsigned long d = 0; d < devices; d++) {
+      device_t *dev = &devs[d];
+      if (k > 0 && random_uniform() < reset_prob) {
+        dev->snapshot_id = 0;
+        dev->time_synced = 0;
+      } else if (k > 0) {
+        dev->snapshot_id++;
+      }
+      //The firmware only knows the number of missed slots once it has sent a snapshot since the reset
+      if (dev->snapshot_id == 0)
+        dev->missed_slots = RTC_MISSED_SLOTS_UNKNOWN;
+      else
+        for (dev->missed_slots = 0; random_uniform() < MISSED_SLOT_PROB; dev->missed_slots++)
+          ;
+      capture(dev, (uint8_t)(((d + k) % 127) + 1), random_uniform() < coded_share);
+    }
+    //Interleave frame by frame across all devices, starting at a random device every round
+    for (uint16_t frame_number = 0; frame_number < TOTAL_NUMBER_FRAMES; frame_number++) {
+      unsigned long offset = (unsigned long)(random_uniform() * devices);
+      for (unsigned long i = 0; i < devices; i++) {
+        unsigned long d = (i + offset) % devices;
+        //Coded snapshots need fewer frames
+        if (frame_number >= SNAPSHOT_NUMBER_FRAMES(devs[d].payload_length) || random_uniform() < drop_prob)
+          continue;
+        build_frame(&rec, (uint32_t)(first_dev_id + d), &devs[d], k, frame_number);
+        int copies = random_uniform() < dup_prob ? 2 : 1;
+        for (int c = 0; c < copies; c++) {
+          if (emit(&rec) != 0) {
+            fprintf(stderr, "could not send record: %s\n", strerror(errno));
+            return 1;
+          }
+          records++;
+          if (rate > 0.0) {
+            //Pace the output to the requested frame rate
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+            double ahead = records / rate - elapsed;
+            if (ahead > 0.0)
+              nanosleep(&(struct timespec){.tv_sec = (time_t)ahead,
+                                           .tv_nsec = (long)((ahead - (time_t)ahead) * 1e9)}, NULL);
+          }
+        }
+      }
+    }
+    //The ACK of the first frame 0 carries a time sync
+    for (unsigned long d = 0; d < devices; d++)
+      devs[d].time_synced = 1;
+  }
+
+  if (out_file != NULL && fclose(out_file) != 0) {
+    fprintf(stderr, "could not write %s\n", out_path);
+    return 1;
+  }
+  if (out_socket >= 0)
+    close(out_socket);
+  fprintf(stderr, "%llu records for %lu devices and %lu snapshots each\n", records, devices, snapshots);
+  free(devs);
+  return 0;
+}
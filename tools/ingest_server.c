@@ -0,0 +1,641 @@
+//Multi device ingest server for the base station
+//
+//Stella frames of many devices are read by one I/O thread per input (a unix datagram socket or a replay file) and
+//handed to reassembly threads. Every reassembly thread owns a shard of the devices (selected by dev_id), so the
+//reassembly state is never shared. The handoff uses one single-producer/single-consumer ring per pair of I/O and
+//reassembly thread, so neither side takes a lock. Completed snapshots are appended to a snapshot archive or written
+//to a store directory as one file each.
+//
+//Build: make -C tools
+//Usage: tools/_build/ingest_server [-s socket] [-r replay_file].. [-a archive [-f MHz] [-b bits] [-m 0|1] | -o store_dir]
+//                                  [-w reassembly_threads]
+//  -s  bind a unix datagram socket at this path, runs until SIGINT/SIGTERM
+//  -r  replay a file written by ingest_loadgen, may be given several times (one I/O thread each)
+//  -a  snapshot archive (see snapshot_archive.h) the completed snapshots are appended to
+//  -f, -b, -m  max2769 sampling frequency in MHz, adc resolution in bits and min power option the devices run with,
+//      stored in the archive (same values as archive_tool convert -f/-r/-m), unknown if none is given
+//  -o  directory for completed snapshots, one file each
+//      snapshots are only counted if neither -a nor -o is given
+//  -w  number of reassembly threads                     default 4
+//Throughput and latency figures are printed when all inputs have ended.
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "ingest.h"
+#include "snapshot_archive.h"
+#include "snapshot_frame.h"
+
+#define RING_CAPACITY 1024              //records per ring, must be a power of two
+#define RING_BATCH 64                   //records a reassembly thread takes from one ring before moving on
+#define MAX_INPUTS 16
+#define MAX_SHARDS 64
+#define MAX_SNAPSHOT_BYTES (1 << 20)
+#define LATENCY_BUCKETS 48              //log2 buckets of nanoseconds
+#define CACHE_LINE 64
+
+typedef struct {
+  uint64_t receive_ns;
+  ingest_record_t rec;
+} ring_slot_t;
+
+//Lock free ring between exactly one I/O thread (producer) and one reassembly thread (consumer)
+typedef struct {
+  _Alignas(CACHE_LINE) atomic_size_t head;     //next slot to be consumed, only written by the consumer
+  _Alignas(CACHE_LINE) atomic_size_t tail;     //next slot to be produced, only written by the producer
+  _Alignas(CACHE_LINE) ring_slot_t slots[RING_CAPACITY];
+} spsc_ring_t;
+
+typedef struct {
+  uint64_t buckets[LATENCY_BUCKETS];
+  uint64_t count;
+  uint64_t max_ns;
+} latency_hist_t;
+
+typedef struct {
+  uint64_t frames;
+  uint64_t duplicates;
+  uint64_t orphans;             //data frames without the matching frame 0
+  uint64_t malformed;
+  uint64_t snapshots_complete;
+  uint64_t snapshots_incomplete;
+  uint64_t store_errors;
+  uint64_t bytes_stored;
+  latency_hist_t queue_latency;       //from reception by the I/O thread to reassembly
+  latency_hist_t snapshot_latency;    //from reception of frame 0 to the snapshot being stored
+} shard_stats_t;
+
+//Reassembly state of one device
+typedef struct {
+  uint32_t dev_id;
+  int have_frame_0;
+  int complete;
+  uint16_t snapshot_id;
+  frame_0_t frame_0;
+  uint16_t frames_received;           //data frames of the current snapshot
+  uint64_t bitmap[(UINT16_MAX + 1) / 64];
+  uint8_t *samples;
+  size_t samples_length;
+  size_t samples_capacity;
+  uint64_t first_frame_ns;
+  uint64_t stored_count;
+} device_state_t;
+
+typedef struct {
+  unsigned int index;
+  device_state_t **devices;           //open addressing table indexed by dev_id
+  size_t devices_capacity;
+  size_t devices_count;
+  shard_stats_t stats;
+  pthread_t thread;
+} shard_t;
+
+typedef struct {
+  const char *path;
+  int is_socket;
+  unsigned int index;
+  pthread_t thread;
+} input_t;
+
+static spsc_ring_t *rings;              //rings[input * n_shards + shard]
+static shard_t shards[MAX_SHARDS];
+static input_t inputs[MAX_INPUTS];
+static unsigned int n_shards = 4;
+static unsigned int n_inputs;
+static const char *store_dir;
+static const char *archive_name;
+static snapshot_archive_writer_t archive;
+static pthread_mutex_t archive_mutex = PTHREAD_MUTEX_INITIALIZER;
+static atomic_uint inputs_running;
+static atomic_uint_fast64_t first_receive_ns;
+static volatile sig_atomic_t stop_requested;
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static unsigned int shard_of(uint32_t dev_id)
+{
+  //Spread consecutive device ids over all shards
+  uint32_t h = dev_id * 0x9E3779B1u;
+  return (h >> 16) % n_shards;
+}
+
+static spsc_ring_t *ring_of(unsigned int input, unsigned int shard)
+{
+  return &rings[input * n_shards + shard];
+}
+
+static ring_slot_t *ring_reserve(spsc_ring_t *r)
+{
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+  if (tail - head == RING_CAPACITY)
+    return NULL;
+  return &r->slots[tail & (RING_CAPACITY - 1)];
+}
+
+static void ring_commit(spsc_ring_t *r)
+{
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+static ring_slot_t *ring_peek(spsc_ring_t *r)
+{
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  if (head == tail)
+    return NULL;
+  return &r->slots[head & (RING_CAPACITY - 1)];
+}
+
+static void ring_release(spsc_ring_t *r)
+{
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static void hist_add(latency_hist_t *h, uint64_t ns)
+{
+  unsigned int bucket = 0;
+  while (bucket < LATENCY_BUCKETS - 1 && (1ULL << (bucket + 1)) <= ns)
+    bucket++;
+  h->buckets[bucket]++;
+  h->count++;
+  if (ns > h->max_ns)
+    h->max_ns = ns;
+}
+
+static void hist_merge(latency_hist_t *dst, const latency_hist_t *src)
+{
+  for (unsigned int i = 0; i < LATENCY_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+  dst->count += src->count;
+  if (src->max_ns > dst->max_ns)
+    dst->max_ns = src->max_ns;
+}
+
+//Returns the upper bound of the bucket that contains the given quantile, but never more than the maximum
+static double hist_quantile_us(const latency_hist_t *h, double q)
+{
+  uint64_t target = (uint64_t)(q * (double)h->count);
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < LATENCY_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen > target) {
+      uint64_t upper_ns = 1ULL << (i + 1);
+      return (double)(upper_ns < h->max_ns ? upper_ns : h->max_ns) / 1e3;
+    }
+  }
+  return (double)h->max_ns / 1e3;
+}
+
+static device_state_t *lookup_device(shard_t *shard, uint32_t dev_id)
+{
+  if (2 * (shard->devices_count + 1) > shard->devices_capacity) {
+    size_t capacity = shard->devices_capacity ? 2 * shard->devices_capacity : 64;
+    device_state_t **table = calloc(capacity, sizeof(device_state_t *));
+    if (table == NULL)
+      return NULL;
+    for (size_t i = 0; i < shard->devices_capacity; i++) {
+      device_state_t *d = shard->devices[i];
+      if (d == NULL)
+        continue;
+      size_t j = (d->dev_id * 0x9E3779B1u) & (capacity - 1);
+      while (table[j] != NULL)
+        j = (j + 1) & (capacity - 1);
+      table[j] = d;
+    }
+    free(shard->devices);
+    shard->devices = table;
+    shard->devices_capacity = capacity;
+  }
+  size_t j = (dev_id * 0x9E3779B1u) & (shard->devices_capacity - 1);
+  while (shard->devices[j] != NULL) {
+    if (shard->devices[j]->dev_id == dev_id)
+      return shard->devices[j];
+    j = (j + 1) & (shard->devices_capacity - 1);
+  }
+  device_state_t *d = calloc(1, sizeof(device_state_t));
+  if (d == NULL)
+    return NULL;
+  d->dev_id = dev_id;
+  shard->devices[j] = d;
+  shard->devices_count++;
+  return d;
+}
+
+//Writes a completed snapshot as frame 0 followed by the samples
+static int store_snapshot(const device_state_t *d)
+{
+  if (archive_name != NULL) {
+    //Snapshots complete far less often than frames arrive, so the shards can share one archive writer
+    pthread_mutex_lock(&archive_mutex);
+    int result = snapshot_archive_append(&archive, d->dev_id, &d->frame_0, d->samples, (uint32_t)d->samples_length);
+    pthread_mutex_unlock(&archive_mutex);
+    return result;
+  }
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%u_%06llu_%u.bin", store_dir, d->dev_id, (unsigned long long)d->stored_count,
+           d->snapshot_id);
+  FILE *f = fopen(path, "wb");
+  if (f == NULL)
+    return -1;
+  int result = 0;
+  if (fwrite(&d->frame_0, LENGTH_FIRST_FRAME, 1, f) != 1 ||
+      fwrite(d->samples, 1, d->samples_length, f) != d->samples_length)
+    result = -1;
+  if (fclose(f) != 0)
+    result = -1;
+  return result;
+}
+
+static void start_snapshot(shard_t *shard, device_state_t *d, const ring_slot_t *slot, uint16_t snapshot_id)
+{
+  frame_0_t f0;
+  if (snapshot_archive_parse_frame_0(&f0, slot->rec.payload, slot->rec.length) != 0 || f0.total_number_frames < 2 || f0.bytes_per_frame == 0 ||
+      f0.bytes_per_frame > INGEST_MAX_PAYLOAD_LENGTH - LENGTH_FRAME_HEADER || f0.bytes_last_frame == 0 ||
+      f0.bytes_last_frame > f0.bytes_per_frame) {
+    shard->stats.malformed++;
+    return;
+  }
+  size_t length = (size_t)(f0.total_number_frames - 2) * f0.bytes_per_frame + f0.bytes_last_frame;
+  if (length > MAX_SNAPSHOT_BYTES) {
+    shard->stats.malformed++;
+    return;
+  }
+  if (length > d->samples_capacity) {
+    uint8_t *samples = realloc(d->samples, length);
+    if (samples == NULL) {
+      shard->stats.store_errors++;
+      return;
+    }
+    d->samples = samples;
+    d->samples_capacity = length;
+  }
+  if (d->have_frame_0 && !d->complete)
+    shard->stats.snapshots_incomplete++;
+  d->have_frame_0 = 1;
+  d->complete = 0;
+  d->snapshot_id = snapshot_id;
+  d->frame_0 = f0;
+  d->frames_received = 0;
+  d->samples_length = length;
+  d->first_frame_ns = slot->receive_ns;
+  memset(d->bitmap, 0, ((f0.total_number_frames + 63) / 64) * sizeof(uint64_t));
+}
+
+//Returns 1 if a frame 0 is a retransmission of the frame 0 a device's current snapshot started with. Devices
+//restart counting snapshot ids after a reset, so the id alone does not tell a retransmission from a new snapshot
+static int is_retransmitted_frame_0(const device_state_t *d, const ingest_record_t *rec, uint16_t snapshot_id)
+{
+  frame_0_t f0;
+  if (!d->have_frame_0 || d->snapshot_id != snapshot_id ||
+      snapshot_archive_parse_frame_0(&f0, rec->payload, rec->length) != 0)
+    return 0;
+  const frame_0_t *cur = &d->frame_0;
+  return memcmp(&f0.capture_timestamp, &cur->capture_timestamp, sizeof(timestamp_t)) == 0 &&
+         memcmp(&f0.transmit_timestamp, &cur->transmit_timestamp, sizeof(timestamp_t)) == 0 &&
+         f0.total_number_frames == cur->total_number_frames && f0.bytes_per_frame == cur->bytes_per_frame &&
+         f0.bytes_last_frame == cur->bytes_last_frame && f0.time_synced == cur->time_synced &&
+         f0.missed_slots == cur->missed_slots && f0.coder == cur->coder;
+}
+
+static void handle_record(shard_t *shard, const ring_slot_t *slot)
+{
+  const ingest_record_t *rec = &slot->rec;
+  uint16_t snapshot_id, frame_number;
+
+  shard->stats.frames++;
+  if (rec->length < LENGTH_FRAME_HEADER) {
+    shard->stats.malformed++;
+    return;
+  }
+  memcpy(&snapshot_id, rec->payload + OFFSET_SNAPSHOT_ID, LENGTH_SNAPSHOT_ID);
+  memcpy(&frame_number, rec->payload + OFFSET_FRAME_NUMBER, LENGTH_FRAME_NUMBER);
+  device_state_t *d = lookup_device(shard, rec->dev_id);
+  if (d == NULL) {
+    shard->stats.store_errors++;
+    return;
+  }
+
+  if (frame_number == 0) {
+    if (rec->length < LENGTH_FIRST_FRAME_MIN) {
+      shard->stats.malformed++;
+    } else if (is_retransmitted_frame_0(d, rec, snapshot_id)) {
+      //Retransmission because the ACK got lost
+      shard->stats.duplicates++;
+    } else {
+      start_snapshot(shard, d, slot, snapshot_id);
+    }
+    return;
+  }
+
+  if (!d->have_frame_0 || d->snapshot_id != snapshot_id) {
+    shard->stats.orphans++;
+    return;
+  }
+  const frame_0_t *f0 = &d->frame_0;
+  if (frame_number >= f0->total_number_frames) {
+    shard->stats.malformed++;
+    return;
+  }
+  size_t expected = frame_number == f0->total_number_frames - 1 ? f0->bytes_last_frame : f0->bytes_per_frame;
+  if ((size_t)rec->length - LENGTH_FRAME_HEADER != expected) {
+    shard->stats.malformed++;
+    return;
+  }
+  uint64_t mask = 1ULL << (frame_number % 64);
+  if (d->bitmap[frame_number / 64] & mask) {
+    shard->stats.duplicates++;
+    return;
+  }
+  d->bitmap[frame_number / 64] |= mask;
+  memcpy(d->samples + (size_t)(frame_number - 1) * f0->bytes_per_frame, rec->payload + OFFSET_SNAPSHOT_SAMPLES,
+         expected);
+  d->frames_received++;
+
+  if (d->frames_received == f0->total_number_frames - 1) {
+    d->complete = 1;
+    if (store_dir != NULL || archive_name != NULL) {
+      if (store_snapshot(d) != 0) {
+        shard->stats.store_errors++;
+        return;
+      }
+      shard->stats.bytes_stored += LENGTH_FIRST_FRAME + d->samples_length;
+    }
+    d->stored_count++;
+    shard->stats.snapshots_complete++;
+    hist_add(&shard->stats.snapshot_latency, now_ns() - d->first_frame_ns);
+  }
+}
+
+static void *reassembly_thread(void *arg)
+{
+  shard_t *shard = arg;
+  for (;;) {
+    //Read the flag before draining, so no record committed before the last input ended can be missed
+    int inputs_done = atomic_load_explicit(&inputs_running, memory_order_acquire) == 0;
+    unsigned int processed = 0;
+    for (unsigned int i = 0; i < n_inputs; i++) {
+      spsc_ring_t *r = ring_of(i, shard->index);
+      ring_slot_t *slot;
+      for (unsigned int k = 0; k < RING_BATCH && (slot = ring_peek(r)) != NULL; k++) {
+        hist_add(&shard->stats.queue_latency, now_ns() - slot->receive_ns);
+        handle_record(shard, slot);
+        ring_release(r);
+        processed++;
+      }
+    }
+    if (processed == 0) {
+      if (inputs_done)
+        break;
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+//Hands a record to the shard that owns the device, waits while the ring is full
+static void dispatch(unsigned int input, const uint8_t *buf, size_t length)
+{
+  ingest_record_t hdr;
+  if (length < INGEST_RECORD_HEADER_LENGTH || ingest_record_decode_header(buf, &hdr) != 0 ||
+      (size_t)INGEST_RECORD_HEADER_LENGTH + hdr.length != length)
+    return;
+  spsc_ring_t *r = ring_of(input, shard_of(hdr.dev_id));
+  ring_slot_t *slot;
+  while ((slot = ring_reserve(r)) == NULL)
+    sched_yield();
+  slot->receive_ns = now_ns();
+  //Only the first record writes the shared start time, later ones just read it
+  if (atomic_load_explicit(&first_receive_ns, memory_order_relaxed) == 0) {
+    uint_fast64_t expected = 0;
+    atomic_compare_exchange_strong(&first_receive_ns, &expected, slot->receive_ns);
+  }
+  slot->rec.dev_id = hdr.dev_id;
+  slot->rec.length = hdr.length;
+  memcpy(slot->rec.payload, buf + INGEST_RECORD_HEADER_LENGTH, hdr.length);
+  ring_commit(r);
+}
+
+static void read_replay_file(input_t *in)
+{
+  FILE *f = fopen(in->path, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "could not open %s: %s\n", in->path, strerror(errno));
+    return;
+  }
+  static _Thread_local char file_buf[1 << 20];
+  setvbuf(f, file_buf, _IOFBF, sizeof(file_buf));
+  uint8_t buf[INGEST_MAX_RECORD_LENGTH];
+  ingest_record_t hdr;
+  while (!stop_requested && fread(buf, INGEST_RECORD_HEADER_LENGTH, 1, f) == 1) {
+    if (ingest_record_decode_header(buf, &hdr) != 0) {
+      fprintf(stderr, "%s: corrupt record\n", in->path);
+      break;
+    }
+    if (hdr.length > 0 && fread(buf + INGEST_RECORD_HEADER_LENGTH, hdr.length, 1, f) != 1)
+      break;
+    dispatch(in->index, buf, INGEST_RECORD_HEADER_LENGTH + hdr.length);
+  }
+  fclose(f);
+}
+
+static void read_socket(input_t *in)
+{
+  int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (fd < 0 || strlen(in->path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "could not create socket %s\n", in->path);
+    return;
+  }
+  strcpy(addr.sun_path, in->path);
+  unlink(in->path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    fprintf(stderr, "could not bind %s: %s\n", in->path, strerror(errno));
+    close(fd);
+    return;
+  }
+  //Wake up regularly to check whether the server shall stop
+  struct timeval timeout = {.tv_sec = 0, .tv_usec = 100000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  int rcvbuf = 8 << 20;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+  uint8_t buf[INGEST_MAX_RECORD_LENGTH];
+  while (!stop_requested) {
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n > 0)
+      dispatch(in->index, buf, (size_t)n);
+  }
+  close(fd);
+  unlink(in->path);
+}
+
+static void *io_thread(void *arg)
+{
+  input_t *in = arg;
+  if (in->is_socket)
+    read_socket(in);
+  else
+    read_replay_file(in);
+  atomic_fetch_sub_explicit(&inputs_running, 1, memory_order_release);
+  return NULL;
+}
+
+static void on_signal(int sig)
+{
+  (void)sig;
+  stop_requested = 1;
+}
+
+static void print_stats(uint64_t elapsed_ns)
+{
+  shard_stats_t total;
+  memset(&total, 0, sizeof(total));
+  for (unsigned int s = 0; s < n_shards; s++) {
+    const shard_stats_t *st = &shards[s].stats;
+    total.frames += st->frames;
+    total.duplicates += st->duplicates;
+    total.orphans += st->orphans;
+    total.malformed += st->malformed;
+    total.snapshots_complete += st->snapshots_complete;
+    total.snapshots_incomplete += st->snapshots_incomplete;
+    total.store_errors += st->store_errors;
+    total.bytes_stored += st->bytes_stored;
+    hist_merge(&total.queue_latency, &st->queue_latency);
+    hist_merge(&total.snapshot_latency, &st->snapshot_latency);
+  }
+  double seconds = (double)elapsed_ns / 1e9;
+  if (seconds <= 0.0)
+    seconds = 1e-9;
+  printf("inputs: %u, reassembly threads: %u\n", n_inputs, n_shards);
+  printf("frames: %llu (%.0f frames/s), duplicates: %llu, orphans: %llu, malformed: %llu\n",
+         (unsigned long long)total.frames, total.frames / seconds, (unsigned long long)total.duplicates,
+         (unsigned long long)total.orphans, (unsigned long long)total.malformed);
+  printf("snapshots: %llu complete (%.0f snapshots/s), %llu incomplete, %llu store errors, %.1f MB stored\n",
+         (unsigned long long)total.snapshots_complete, total.snapshots_complete / seconds,
+         (unsigned long long)total.snapshots_incomplete, (unsigned long long)total.store_errors,
+         (double)total.bytes_stored / 1e6);
+  printf("queue latency: p50 <= %.1f us, p99 <= %.1f us, max %.1f us\n", hist_quantile_us(&total.queue_latency, 0.5),
+         hist_quantile_us(&total.queue_latency, 0.99), (double)total.queue_latency.max_ns / 1e3);
+  printf("snapshot latency: p50 <= %.1f us, p99 <= %.1f us, max %.1f us\n",
+         hist_quantile_us(&total.snapshot_latency, 0.5), hist_quantile_us(&total.snapshot_latency, 0.99),
+         (double)total.snapshot_latency.max_ns / 1e3);
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-s socket] [-r replay_file].. [-a archive [-f MHz] [-b bits] [-m 0|1] | -o store_dir] "
+                  "[-w reassembly_threads]\n",
+          name);
+}
+
+int main(int argc, char **argv)
+{
+  int opt;
+  max2769_cfg_t cfg = {.sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M4,
+                       .adc_resolution = MAX2769_ADC_RESOLUTION_1B,
+                       .min_power_option = MAX2769_MIN_POWER_OPTION_DISABLE};
+  int cfg_known = 0;
+  while ((opt = getopt(argc, argv, "s:r:a:o:w:f:b:m:h")) != -1) {
+    switch (opt) {
+      case 's':
+      case 'r':
+        if (n_inputs == MAX_INPUTS) {
+          fprintf(stderr, "at most %d inputs are supported\n", MAX_INPUTS);
+          return 1;
+        }
+        inputs[n_inputs].path = optarg;
+        inputs[n_inputs].is_socket = opt == 's';
+        inputs[n_inputs].index = n_inputs;
+        n_inputs++;
+        break;
+      case 'a': archive_name = optarg; break;
+      case 'o': store_dir = optarg; break;
+      case 'w': n_shards = (unsigned int)strtoul(optarg, NULL, 10); break;
+      case 'f':
+      case 'b':
+      case 'm':
+        cfg_known = 1;
+        if (snapshot_archive_parse_cfg(&cfg, opt == 'b' ? 'r' : (char)opt, optarg) != 0) {
+          usage(argv[0]);
+          return 1;
+        }
+        break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (n_inputs == 0 || optind != argc || n_shards < 1 || n_shards > MAX_SHARDS ||
+      (archive_name != NULL && store_dir != NULL)) {
+    usage(argv[0]);
+    return 1;
+  }
+  if (store_dir != NULL && mkdir(store_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "could not create %s: %s\n", store_dir, strerror(errno));
+    return 1;
+  }
+  if (archive_name != NULL && snapshot_archive_writer_open(&archive, archive_name, cfg_known ? &cfg : NULL) != 0) {
+    fprintf(stderr, "could not open archive %s\n", archive_name);
+    return 1;
+  }
+
+  rings = aligned_alloc(CACHE_LINE, sizeof(spsc_ring_t) * n_inputs * n_shards);
+  if (rings == NULL)
+    return 1;
+  for (unsigned int i = 0; i < n_inputs * n_shards; i++) {
+    atomic_init(&rings[i].head, 0);
+    atomic_init(&rings[i].tail, 0);
+  }
+  atomic_init(&inputs_running, n_inputs);
+  atomic_init(&first_receive_ns, 0);
+
+  struct sigaction sa = {.sa_handler = on_signal};
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  for (unsigned int s = 0; s < n_shards; s++) {
+    shards[s].index = s;
+    pthread_create(&shards[s].thread, NULL, reassembly_thread, &shards[s]);
+  }
+  for (unsigned int i = 0; i < n_inputs; i++)
+    pthread_create(&inputs[i].thread, NULL, io_thread, &inputs[i]);
+
+  for (unsigned int i = 0; i < n_inputs; i++)
+    pthread_join(inputs[i].thread, NULL);
+  for (unsigned int s = 0; s < n_shards; s++)
+    pthread_join(shards[s].thread, NULL);
+  uint64_t start = atomic_load(&first_receive_ns);
+  print_stats(start ? now_ns() - start : 0);
+
+  for (unsigned int s = 0; s < n_shards; s++) {
+    for (size_t i = 0; i < shards[s].devices_capacity; i++) {
+      if (shards[s].devices[i] != NULL)
+        free(shards[s].devices[i]->samples);
+      free(shards[s].devices[i]);
+    }
+    free(shards[s].devices);
+  }
+  free(rings);
+  if (archive_name != NULL && snapshot_archive_writer_close(&archive) != 0) {
+    fprintf(stderr, "could not close archive %s\n", archive_name);
+    return 1;
+  }
+  return 0;
+}
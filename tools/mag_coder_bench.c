@@ -0,0 +1,238 @@
+//Benchmark of the magnitude bit coder in src/mag_coder.c
+//
+//Codes snapshots with the same code the firmware runs, decodes them again, checks that the round trip is lossless
+//and reports the coded size, the resulting number of frames and the throughput of both directions.
+//
+//Build: make -C tools
+//Usage: tools/_build/mag_coder_bench [options] [snapshot_file]..
+//  Snapshot files hold the raw samples of one snapshot each. Files written by ingest_server -o start with frame 0,
+//  pass -s to skip it. Without files synthetic snapshots of gaussian noise are quantized like the max2769 does.
+//  -b  bits per sample (2: 1.5 and 2 bit resolution, 3: 2.5 and 3 bit resolution)   default 2
+//  -s  skip frame 0 at the start of every file, snapshots that frame 0 marks as coded are decoded first and use the
+//      bits per sample of their coded stream instead of -b
+//  -g  share of synthetic samples with the magnitude msb set                        default 0.33
+//      (the AGC target of the default GAINREF, 170 of 512)
+//  -c  correlation of consecutive synthetic samples                                  default 0.3
+//  -n  number of synthetic snapshots                                                 default 100
+//  -l  length of synthetic snapshots in bytes                                        default SNAPSHOT_SIZE_BYTES
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mag_coder.h"
+#include "snapshot_archive.h"
+#include "snapshot_frame.h"
+
+typedef struct {
+  uint8_t *data;
+  uint32_t length;
+  uint8_t bits_per_sample;
+} snapshot_t;
+
+static double now(void)
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double gaussian(void)
+{
+  double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+  return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+//Returns t with P(|x| >= t) = share for standard normal x
+static double two_sided_quantile(double share)
+{
+  double lo = 0.0, hi = 10.0;
+  for (int i = 0; i < 100; i++) {
+    double mid = (lo + hi) / 2;
+    if (erfc(mid / sqrt(2.0)) > share)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void synthesize(snapshot_t *s, uint32_t length, uint8_t bits_per_sample, double msb_share, double correlation)
+{
+  uint32_t levels = 1u << (bits_per_sample - 1);
+  //The magnitude msb is set from level levels/2 upwards
+  double step = two_sided_quantile(msb_share) / (levels / 2);
+  uint32_t n_samples = length * 8 / bits_per_sample;
+  double x = gaussian();
+
+  s->data = calloc(length, 1);
+  s->length = length;
+  for (uint32_t k = 0; k < n_samples; k++) {
+    x = correlation * x + sqrt(1.0 - correlation * correlation) * gaussian();
+    uint32_t mag = (uint32_t)(fabs(x) / step);
+    if (mag > levels - 1)
+      mag = levels - 1;
+    uint32_t sample = ((x < 0) << (bits_per_sample - 1)) | mag;
+    for (int i = bits_per_sample - 1; i >= 0; i--) {
+      uint32_t position = k * bits_per_sample + (bits_per_sample - 1 - i);
+      if ((sample >> i) & 1)
+        s->data[position / 8] |= 0x80 >> (position % 8);
+    }
+  }
+}
+
+//Reads the raw samples of a snapshot file, coded snapshots are decoded. Returns -1 if the file cannot be read or
+//decoded or frame 0 names an unknown coder
+static int load(snapshot_t *s, const char *path, int skip_frame_0, uint8_t bits_per_sample)
+{
+  FILE *f = fopen(path, "rb");
+  if (f == NULL)
+    return -1;
+  fseek(f, 0, SEEK_END);
+  long length = ftell(f);
+  uint8_t *data = length > 0 ? malloc((size_t)length) : NULL;
+  rewind(f);
+  if (data == NULL || fread(data, (size_t)length, 1, f) != 1) {
+    free(data);
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  //Frame 0 of older firmware is shorter, its length follows from the sample bytes it announces
+  frame_0_t frame_0;
+  frame_0.coder = MAG_CODER_NONE;
+  long offset = skip_frame_0 ? snapshot_archive_parse_file(&frame_0, data, (size_t)length) : 0;
+  if (offset < 0 || (frame_0.coder != MAG_CODER_NONE && frame_0.coder != MAG_CODER_RANGE)) {
+    free(data);
+    return -1;
+  }
+  const uint8_t *payload = data + offset;
+  uint32_t payload_length = (uint32_t)(length - offset);
+  if (frame_0.coder == MAG_CODER_RANGE) {
+    //The coded stream records the bits per sample the device ran with
+    s->length = mag_coder_decoded_length(payload, payload_length);
+    s->data = s->length > 0 ? malloc(s->length) : NULL;
+    if (s->data == NULL || mag_coder_decode(payload, payload_length, s->data, s->length) != s->length) {
+      free(s->data);
+      free(data);
+      return -1;
+    }
+    s->bits_per_sample = payload[4];
+  } else {
+    s->length = payload_length;
+    s->data = malloc(s->length);
+    memcpy(s->data, payload, s->length);
+    s->bits_per_sample = bits_per_sample;
+  }
+  free(data);
+  return 0;
+}
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-b bits_per_sample] [-s] [-g msb_share] [-c correlation] [-n snapshots] [-l length] "
+                  "[snapshot_file]..\n", name);
+}
+
+int main(int argc, char **argv)
+{
+  int bits_per_sample = 2;
+  int skip_frame_0 = 0;
+  double msb_share = 0.33;
+  double correlation = 0.3;
+  int n_synthetic = 100;
+  long synthetic_length = SNAPSHOT_SIZE_BYTES;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:sg:c:n:l:h")) != -1) {
+    switch (opt) {
+      case 'b': bits_per_sample = atoi(optarg); break;
+      case 's': skip_frame_0 = 1; break;
+      case 'g': msb_share = atof(optarg); break;
+      case 'c': correlation = atof(optarg); break;
+      case 'n': n_synthetic = atoi(optarg); break;
+      case 'l': synthetic_length = atol(optarg); break;
+      default: usage(argv[0]); return 1;
+    }
+  }
+  if (bits_per_sample < 2 || bits_per_sample > MAG_CODER_MAX_BITS_PER_SAMPLE || msb_share <= 0 || msb_share >= 1 ||
+      correlation < 0 || correlation >= 1 || n_synthetic < 1 || synthetic_length < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  size_t count = optind < argc ? (size_t)(argc - optind) : (size_t)n_synthetic;
+  snapshot_t *snapshots = calloc(count, sizeof(snapshot_t));
+  srand(1);
+  for (size_t i = 0; i < count; i++) {
+    if (optind < argc) {
+      if (load(&snapshots[i], argv[optind + i], skip_frame_0, (uint8_t)bits_per_sample) != 0) {
+        fprintf(stderr, "could not read %s\n", argv[optind + i]);
+        return 1;
+      }
+    } else {
+      synthesize(&snapshots[i], (uint32_t)synthetic_length, (uint8_t)bits_per_sample, msb_share, correlation);
+      snapshots[i].bits_per_sample = (uint8_t)bits_per_sample;
+    }
+  }
+
+  uint64_t raw_bytes = 0, coded_bytes = 0, raw_frames = 0, coded_frames = 0;
+  double encode_s = 0, decode_s = 0;
+  size_t not_smaller = 0, mismatches = 0;
+  //Coded files bring their own bits per sample, 0 once they differ between snapshots
+  int common_bits = snapshots[0].bits_per_sample;
+  double sign_bytes = 0;
+  for (size_t i = 0; i < count; i++) {
+    snapshot_t *s = &snapshots[i];
+    if (s->bits_per_sample != common_bits)
+      common_bits = 0;
+    sign_bytes += (double)s->length / s->bits_per_sample;
+    //The firmware codes into a buffer of the raw snapshot size and sends the raw snapshot if the coded one does not fit
+    uint8_t *coded = malloc(s->length);
+    uint8_t *decoded = malloc(s->length);
+    double t0 = now();
+    uint32_t coded_length = mag_coder_encode(s->data, s->length, s->bits_per_sample, coded, s->length);
+    double t1 = now();
+    encode_s += t1 - t0;
+    raw_bytes += s->length;
+    raw_frames += SNAPSHOT_NUMBER_FRAMES(s->length);
+    if (coded_length == 0) {
+      not_smaller++;
+      coded_bytes += s->length;
+      coded_frames += SNAPSHOT_NUMBER_FRAMES(s->length);
+    } else {
+      t0 = now();
+      uint32_t decoded_length = mag_coder_decode(coded, coded_length, decoded, s->length);
+      decode_s += now() - t0;
+      if (decoded_length != s->length || memcmp(decoded, s->data, s->length) != 0)
+        mismatches++;
+      coded_bytes += coded_length;
+      coded_frames += SNAPSHOT_NUMBER_FRAMES(coded_length);
+    }
+    free(coded);
+    free(decoded);
+    free(s->data);
+  }
+  free(snapshots);
+
+  //Sign bits are stored as they are, so the remaining bits show what the coder achieves on the magnitude bits
+  double sign_share = sign_bytes / raw_bytes;
+  double coded_share = (double)coded_bytes / raw_bytes;
+  if (common_bits)
+    printf("%zu snapshots, %d bits per sample, %s\n", count, common_bits, optind < argc ? "recorded" : "synthetic");
+  else
+    printf("%zu snapshots, mixed bits per sample, %s\n", count, optind < argc ? "recorded" : "synthetic");
+  printf("raw %llu bytes, coded %llu bytes, ratio %.3f, %.3f bits per magnitude bit\n",
+         (unsigned long long)raw_bytes, (unsigned long long)coded_bytes, coded_share,
+         (coded_share - sign_share) / (1.0 - sign_share));
+  printf("frames per snapshot: raw %.1f, coded %.1f (1 bit snapshot of the same duration: %.1f)\n",
+         (double)raw_frames / count, (double)coded_frames / count,
+         (double)SNAPSHOT_NUMBER_FRAMES((uint64_t)(sign_bytes / count)));
+  printf("encode %.1f MB/s, decode %.1f MB/s (raw bytes)\n", encode_s > 0 ? raw_bytes / 1e6 / encode_s : 0.0,
+         decode_s > 0 ? raw_bytes / 1e6 / decode_s : 0.0);
+  printf("not smaller: %zu, round trip mismatches: %zu\n", not_smaller, mismatches);
+  return mismatches ? 1 : 0;
+}
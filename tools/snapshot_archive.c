@@ -0,0 +1,336 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mag_coder.h"
+#include "snapshot_archive.h"
+
+#define PATH_LENGTH 4096
+
+typedef struct {
+  uint32_t dev_id;
+  uint32_t position;
+  uint64_t time_key;
+} sort_entry_t;
+
+static int archive_path(char *path, const char *name, const char *suffix)
+{
+  return snprintf(path, PATH_LENGTH, "%s%s", name, suffix) < PATH_LENGTH ? 0 : -1;
+}
+
+static uint64_t round_up_to_page(uint64_t n)
+{
+  return (n + SNAPSHOT_ARCHIVE_PAGE_SIZE - 1) & ~(uint64_t)(SNAPSHOT_ARCHIVE_PAGE_SIZE - 1);
+}
+
+static int write_all(int fd, const void *buf, size_t length, off_t offset)
+{
+  const uint8_t *p = buf;
+  while (length > 0) {
+    ssize_t n = pwrite(fd, p, length, offset);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    p += n;
+    offset += n;
+    length -= (size_t)n;
+  }
+  return 0;
+}
+
+//Accepts archives from min_version up to the current version
+static int check_file_header(const snapshot_archive_file_header_t *fh, uint32_t min_version)
+{
+  if (memcmp(fh->magic, SNAPSHOT_ARCHIVE_MAGIC, sizeof(fh->magic)) != 0 || fh->version < min_version ||
+      fh->version > SNAPSHOT_ARCHIVE_VERSION ||
+      fh->page_size != SNAPSHOT_ARCHIVE_PAGE_SIZE || fh->header_size != sizeof(snapshot_archive_header_t))
+    return -1;
+  return 0;
+}
+
+int snapshot_archive_parse_cfg(max2769_cfg_t *cfg, char field, const char *value)
+{
+  switch (field) {
+    case 'f':
+      switch (atoi(value)) {
+        case 4: cfg->sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M4; return 0;
+        case 8: cfg->sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M8; return 0;
+        case 16: cfg->sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M16; return 0;
+        case 32: cfg->sampling_frequency = MAX2769_SAMPLING_FREQUENCY_M32; return 0;
+        default: return -1;
+      }
+    case 'r': {
+      int half_bits = (int)(atof(value) * 2.0 + 0.5);
+      if (half_bits < 2 || half_bits > 6)
+        return -1;
+      cfg->adc_resolution = (max2769_adc_resolution_t)(half_bits - 2);
+      return 0;
+    }
+    case 'm':
+      cfg->min_power_option = atoi(value) ? MAX2769_MIN_POWER_OPTION_ENABLE : MAX2769_MIN_POWER_OPTION_DISABLE;
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+int snapshot_archive_parse_frame_0(frame_0_t *frame_0, const uint8_t *data, size_t length)
+{
+  if (length < LENGTH_FIRST_FRAME_MIN)
+    return -1;
+  memset(frame_0, 0, sizeof(*frame_0));
+  frame_0->time_synced = 0;
+  frame_0->missed_slots = RTC_MISSED_SLOTS_UNKNOWN;
+  frame_0->coder = MAG_CODER_NONE;
+  //Fields are appended in the order of frame_0_t, so a shorter frame 0 is a prefix of it
+  memcpy(frame_0, data, length < LENGTH_FIRST_FRAME ? length : LENGTH_FIRST_FRAME);
+  return 0;
+}
+
+long snapshot_archive_parse_file(frame_0_t *frame_0, const uint8_t *data, size_t length)
+{
+  if (snapshot_archive_parse_frame_0(frame_0, data, length) != 0 || frame_0->total_number_frames < 2)
+    return -1;
+  size_t samples_length = (size_t)(frame_0->total_number_frames - 2) * frame_0->bytes_per_frame + frame_0->bytes_last_frame;
+  if (samples_length >= length)
+    return -1;
+  size_t offset = length - samples_length;
+  if (offset < LENGTH_FIRST_FRAME_MIN || offset > LENGTH_FIRST_FRAME)
+    return -1;
+  //Parse again so only the fields that are in the file are taken
+  snapshot_archive_parse_frame_0(frame_0, data, offset);
+  return (long)offset;
+}
+
+uint64_t snapshot_archive_time_key(const timestamp_t *t)
+{
+  //The RTC of the devices starts at zero, so the key only has to preserve the order and not the exact duration
+  uint64_t key = (uint64_t)t->year * 12 + t->month;
+  key = key * 31 + t->day;
+  key = key * 24 + t->hour;
+  key = key * 60 + t->minute;
+  key = key * 60 + t->second;
+  return key * 100 + t->hundredths;
+}
+
+int snapshot_archive_writer_open(snapshot_archive_writer_t *w, const char *name, const max2769_cfg_t *cfg)
+{
+  char path[PATH_LENGTH];
+  struct stat st;
+
+  w->idx_fd = -1;
+  w->dat_fd = -1;
+  w->cfg = cfg;
+  if (archive_path(path, name, ".idx") != 0 || (w->idx_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0 ||
+      fstat(w->idx_fd, &st) != 0)
+    goto error;
+
+  snapshot_archive_file_header_t fh;
+  if (st.st_size == 0) {
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, SNAPSHOT_ARCHIVE_MAGIC, sizeof(fh.magic));
+    fh.version = SNAPSHOT_ARCHIVE_VERSION;
+    fh.page_size = SNAPSHOT_ARCHIVE_PAGE_SIZE;
+    fh.header_size = sizeof(snapshot_archive_header_t);
+    if (write_all(w->idx_fd, &fh, sizeof(fh), 0) != 0)
+      goto error;
+  } else {
+    if (pread(w->idx_fd, &fh, sizeof(fh), 0) != (ssize_t)sizeof(fh) || check_file_header(&fh, SNAPSHOT_ARCHIVE_VERSION) != 0)
+      goto error;
+    //Drop a header that was only partially written before a crash
+    off_t complete = sizeof(fh) + (st.st_size - (off_t)sizeof(fh)) / sizeof(snapshot_archive_header_t) *
+                                      sizeof(snapshot_archive_header_t);
+    if (complete != st.st_size && ftruncate(w->idx_fd, complete) != 0)
+      goto error;
+  }
+
+  if (archive_path(path, name, ".dat") != 0 || (w->dat_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0 ||
+      fstat(w->dat_fd, &st) != 0)
+    goto error;
+  w->dat_length = (uint64_t)st.st_size;
+  return 0;
+
+error:
+  snapshot_archive_writer_close(w);
+  return -1;
+}
+
+int snapshot_archive_append(snapshot_archive_writer_t *w, uint32_t dev_id, const frame_0_t *frame_0,
+                            const uint8_t *samples, uint32_t samples_length)
+{
+  //The archive only holds raw samples, coded snapshots are decoded on the way in
+  if (frame_0->coder != MAG_CODER_NONE) {
+    uint32_t length = frame_0->coder == MAG_CODER_RANGE ? mag_coder_decoded_length(samples, samples_length) : 0;
+    uint8_t *decoded = length > 0 ? malloc(length) : NULL;
+    if (decoded == NULL || mag_coder_decode(samples, samples_length, decoded, length) != length) {
+      free(decoded);
+      return -1;
+    }
+    //The header describes the stored samples, not the frames the coded snapshot was sent in
+    frame_0_t raw = *frame_0;
+    raw.coder = MAG_CODER_NONE;
+    raw.total_number_frames = SNAPSHOT_NUMBER_FRAMES(length);
+    raw.bytes_per_frame = SNAPSHOT_BYTES_PER_FRAME;
+    raw.bytes_last_frame = SNAPSHOT_BYTES_LAST_FRAME_OF(length);
+    int result = snapshot_archive_append(w, dev_id, &raw, decoded, length);
+    free(decoded);
+    return result;
+  }
+
+  snapshot_archive_header_t h;
+  memset(&h, 0, sizeof(h));
+  h.dev_id = dev_id;
+  h.snapshot_id = frame_0->snapshot_id;
+  h.total_number_frames = frame_0->total_number_frames;
+  h.bytes_per_frame = frame_0->bytes_per_frame;
+  h.bytes_last_frame = frame_0->bytes_last_frame;
+  h.capture_timestamp = frame_0->capture_timestamp;
+  h.transmit_timestamp = frame_0->transmit_timestamp;
+  h.time_synced = frame_0->time_synced;
+  h.missed_slots = frame_0->missed_slots;
+  h.sampling_frequency = w->cfg != NULL ? (uint8_t)w->cfg->sampling_frequency : SNAPSHOT_ARCHIVE_CFG_UNKNOWN;
+  h.adc_resolution = w->cfg != NULL ? (uint8_t)w->cfg->adc_resolution : SNAPSHOT_ARCHIVE_CFG_UNKNOWN;
+  h.min_power_option = w->cfg != NULL ? (uint8_t)w->cfg->min_power_option : SNAPSHOT_ARCHIVE_CFG_UNKNOWN;
+  h.samples_length = samples_length;
+  h.samples_offset = round_up_to_page(w->dat_length);
+  h.time_key = snapshot_archive_time_key(&frame_0->capture_timestamp);
+
+  //Samples first, so the header never refers to data that is not there yet
+  if (write_all(w->dat_fd, samples, samples_length, (off_t)h.samples_offset) != 0)
+    return -1;
+  w->dat_length = h.samples_offset + samples_length;
+  off_t idx_end = lseek(w->idx_fd, 0, SEEK_END);
+  if (idx_end < 0 || write_all(w->idx_fd, &h, sizeof(h), idx_end) != 0)
+    return -1;
+  return 0;
+}
+
+int snapshot_archive_writer_close(snapshot_archive_writer_t *w)
+{
+  int result = 0;
+  if (w->dat_fd >= 0 && close(w->dat_fd) != 0)
+    result = -1;
+  if (w->idx_fd >= 0 && close(w->idx_fd) != 0)
+    result = -1;
+  w->dat_fd = -1;
+  w->idx_fd = -1;
+  return result;
+}
+
+static const void *map_file(const char *path, size_t *length)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0)
+    return NULL;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return NULL;
+  }
+  *length = (size_t)st.st_size;
+  //mmap does not accept empty mappings, an empty file is represented by a non-NULL dummy pointer
+  void *map = *length > 0 ? mmap(NULL, *length, PROT_READ, MAP_SHARED, fd, 0) : (void *)"";
+  close(fd);
+  return map == MAP_FAILED ? NULL : map;
+}
+
+static int compare_entries(const void *a, const void *b)
+{
+  const sort_entry_t *x = a, *y = b;
+  if (x->dev_id != y->dev_id)
+    return x->dev_id < y->dev_id ? -1 : 1;
+  if (x->time_key != y->time_key)
+    return x->time_key < y->time_key ? -1 : 1;
+  return x->position < y->position ? -1 : (x->position > y->position);
+}
+
+int snapshot_archive_open(snapshot_archive_t *a, const char *name)
+{
+  char path[PATH_LENGTH];
+  memset(a, 0, sizeof(*a));
+  if (archive_path(path, name, ".idx") != 0 || (a->idx_map = map_file(path, &a->idx_length)) == NULL)
+    goto error;
+  if (archive_path(path, name, ".dat") != 0 || (a->dat_map = map_file(path, &a->dat_length)) == NULL)
+    goto error;
+  if (a->idx_length < sizeof(snapshot_archive_file_header_t) ||
+      check_file_header((const snapshot_archive_file_header_t *)a->idx_map, SNAPSHOT_ARCHIVE_MIN_VERSION) != 0)
+    goto error;
+  a->version = ((const snapshot_archive_file_header_t *)a->idx_map)->version;
+
+  a->headers = (const snapshot_archive_header_t *)(a->idx_map + sizeof(snapshot_archive_file_header_t));
+  a->count = (a->idx_length - sizeof(snapshot_archive_file_header_t)) / sizeof(snapshot_archive_header_t);
+  //Headers of a writer that crashed between writing samples and header are never visible, but a truncated
+  //data file would leave headers pointing past its end
+  while (a->count > 0 &&
+         a->headers[a->count - 1].samples_offset + a->headers[a->count - 1].samples_length > a->dat_length)
+    a->count--;
+
+  sort_entry_t *entries = malloc((a->count ? a->count : 1) * sizeof(sort_entry_t));
+  a->order = malloc((a->count ? a->count : 1) * sizeof(uint32_t));
+  if (entries == NULL || a->order == NULL) {
+    free(entries);
+    goto error;
+  }
+  for (size_t i = 0; i < a->count; i++) {
+    entries[i].dev_id = a->headers[i].dev_id;
+    entries[i].position = (uint32_t)i;
+    entries[i].time_key = a->headers[i].time_key;
+  }
+  qsort(entries, a->count, sizeof(sort_entry_t), compare_entries);
+  for (size_t i = 0; i < a->count; i++)
+    a->order[i] = entries[i].position;
+  free(entries);
+  return 0;
+
+error:
+  snapshot_archive_close(a);
+  return -1;
+}
+
+void snapshot_archive_close(snapshot_archive_t *a)
+{
+  if (a->idx_map != NULL && a->idx_length > 0)
+    munmap((void *)a->idx_map, a->idx_length);
+  if (a->dat_map != NULL && a->dat_length > 0)
+    munmap((void *)a->dat_map, a->dat_length);
+  free(a->order);
+  memset(a, 0, sizeof(*a));
+}
+
+const uint8_t *snapshot_archive_samples(const snapshot_archive_t *a, const snapshot_archive_header_t *h)
+{
+  return a->dat_map + h->samples_offset;
+}
+
+//Returns the first position in a->order that does not sort before (dev_id, time_key)
+static size_t lower_bound(const snapshot_archive_t *a, uint32_t dev_id, uint64_t time_key)
+{
+  size_t lo = 0, hi = a->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    const snapshot_archive_header_t *h = &a->headers[a->order[mid]];
+    if (h->dev_id < dev_id || (h->dev_id == dev_id && h->time_key < time_key))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+size_t snapshot_archive_find(const snapshot_archive_t *a, uint32_t dev_id, uint64_t from, uint64_t to, size_t *first)
+{
+  if (to <= from) {
+    *first = 0;
+    return 0;
+  }
+  size_t begin = lower_bound(a, dev_id, from);
+  size_t end = lower_bound(a, dev_id, to);
+  *first = begin;
+  return end - begin;
+}
@@ -0,0 +1,107 @@
+#ifndef __SNAPSHOT_ARCHIVE_H_
+#define __SNAPSHOT_ARCHIVE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "max2769.h"
+#include "snapshot_frame.h"
+
+//Indexed archive of reassembled snapshots
+//
+//An archive consists of two files that are only ever appended to:
+//  <name>.idx  a 64 byte file header followed by one fixed size snapshot_archive_header_t per snapshot
+//  <name>.dat  the samples of every snapshot, each one starting at a page boundary
+//The samples are written before their header, so a header that is visible to a reader always refers to complete
+//samples. Readers map both files and access headers and samples in place, without copying or parsing.
+//All fields are little endian.
+//
+//Version 2 stores time_synced and missed_slots in bytes that version 1 reserved and left 0. Readers accept both
+//versions, for a version 1 archive they report both fields as unknown (see snapshot_archive_t.version). Writers
+//only append to archives of the current version, so one archive never mixes both layouts.
+
+#define SNAPSHOT_ARCHIVE_MAGIC "GNSSARC1"
+#define SNAPSHOT_ARCHIVE_VERSION 2
+#define SNAPSHOT_ARCHIVE_MIN_VERSION 1
+#define SNAPSHOT_ARCHIVE_PAGE_SIZE 4096
+#define SNAPSHOT_ARCHIVE_CFG_UNKNOWN 0xFF
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t page_size;
+  uint32_t header_size;
+  uint8_t reserved[44];
+} snapshot_archive_file_header_t;
+
+typedef struct {
+  uint32_t dev_id;
+  uint16_t snapshot_id;
+  uint16_t total_number_frames;
+  uint16_t bytes_per_frame;
+  uint16_t bytes_last_frame;
+  timestamp_t capture_timestamp;
+  timestamp_t transmit_timestamp;
+  uint8_t sampling_frequency;     //max2769_sampling_frequency_t or SNAPSHOT_ARCHIVE_CFG_UNKNOWN
+  uint8_t adc_resolution;         //max2769_adc_resolution_t or SNAPSHOT_ARCHIVE_CFG_UNKNOWN
+  uint8_t min_power_option;       //max2769_min_power_option_t or SNAPSHOT_ARCHIVE_CFG_UNKNOWN
+  uint8_t time_synced;            //copied from frame 0, reserved (0) in version 1
+  uint32_t samples_length;
+  uint8_t missed_slots;           //copied from frame 0, reserved (0) in version 1
+  uint8_t reserved1[3];
+  uint64_t samples_offset;        //offset in the .dat file, multiple of SNAPSHOT_ARCHIVE_PAGE_SIZE
+  uint64_t time_key;              //capture time for ordering, see snapshot_archive_time_key
+  uint8_t reserved2[8];
+} snapshot_archive_header_t;
+
+_Static_assert(sizeof(snapshot_archive_file_header_t) == 64, "archive file header must be 64 bytes");
+_Static_assert(sizeof(snapshot_archive_header_t) == 64, "archive snapshot header must be 64 bytes");
+
+typedef struct {
+  int idx_fd;
+  int dat_fd;
+  uint64_t dat_length;
+  const max2769_cfg_t *cfg;       //configuration the devices run with, may be NULL if unknown
+} snapshot_archive_writer_t;
+
+typedef struct {
+  const uint8_t *idx_map;
+  size_t idx_length;
+  const uint8_t *dat_map;
+  size_t dat_length;
+  const snapshot_archive_header_t *headers;
+  size_t count;
+  uint32_t *order;                //positions of all snapshots sorted by dev_id and time_key
+  uint32_t version;               //version of the file header, time_synced and missed_slots are unknown below 2
+} snapshot_archive_t;
+
+//Sets one field of the max2769 configuration from a command line value: 'f' sampling frequency in MHz (4, 8, 16, 32),
+//'r' adc resolution in bits (1, 1.5, 2, 2.5, 3), 'm' min power option (0, 1). Returns -1 for invalid values
+int snapshot_archive_parse_cfg(max2769_cfg_t *cfg, char field, const char *value);
+
+//Reads frame 0 as received, fields that a shorter frame 0 of older firmware lacks get their defaults
+//Returns -1 if length is below LENGTH_FIRST_FRAME_MIN
+int snapshot_archive_parse_frame_0(frame_0_t *frame_0, const uint8_t *data, size_t length);
+//Reads frame 0 at the start of a snapshot file written by ingest_server -o. The length of frame 0 follows from the
+//file length and the number of sample bytes frame 0 announces. Returns the offset of the samples or -1
+long snapshot_archive_parse_file(frame_0_t *frame_0, const uint8_t *data, size_t length);
+
+//Maps a capture timestamp to a number that orders timestamps chronologically
+uint64_t snapshot_archive_time_key(const timestamp_t *t);
+
+//Opens an archive for appending, the archive is created if it does not exist
+int snapshot_archive_writer_open(snapshot_archive_writer_t *w, const char *name, const max2769_cfg_t *cfg);
+//Appends a snapshot, samples are decoded first if frame 0 names a coder
+int snapshot_archive_append(snapshot_archive_writer_t *w, uint32_t dev_id, const frame_0_t *frame_0,
+                            const uint8_t *samples, uint32_t samples_length);
+int snapshot_archive_writer_close(snapshot_archive_writer_t *w);
+
+//Maps an archive for reading, snapshots appended afterwards are not visible until it is opened again
+int snapshot_archive_open(snapshot_archive_t *a, const char *name);
+void snapshot_archive_close(snapshot_archive_t *a);
+//Returns the samples of a snapshot as a pointer into the mapped archive
+const uint8_t *snapshot_archive_samples(const snapshot_archive_t *a, const snapshot_archive_header_t *h);
+//Finds the snapshots of a device captured in [from, to), returns the number of matches and the first match in
+//a->order via first
+size_t snapshot_archive_find(const snapshot_archive_t *a, uint32_t dev_id, uint64_t from, uint64_t to, size_t *first);
+
+#endif /* __SNAPSHOT_ARCHIVE_H_ */